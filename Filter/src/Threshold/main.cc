@@ -3,6 +3,10 @@
 #include <utility>
 #include <vector>
 
+#include <TriglavPlugInSDK/ChangeTracker.hh>
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/SelectionCoverage.hh>
+#include <TriglavPlugInSDK/SparseContent.hh>
 #include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
 
 namespace Triglav { namespace PlugIn {
@@ -10,7 +14,7 @@ namespace Triglav { namespace PlugIn {
 namespace {
 
 // ModuleId
-String::Data const kModuleId{ u"6904699D-BAF9-4669-893F-0C1F29EB88B3" };
+auto const kModuleId = String::Data::literal( u"6904699D-BAF9-4669-893F-0C1F29EB88B3" );
 
 // CategoryName
 constexpr auto kCategoryName = toStringId( 100 );
@@ -42,20 +46,37 @@ constexpr auto kThresholdMaxValue = 255;
 constexpr auto kThresholdDefaultValue = ( kThresholdMinValue + kThresholdMaxValue ) / 2;
 constexpr auto kThresholdStoreValue = false;
 
-auto makeCaption( std::weak_ptr< Server const > const &server, String::Data const &name, String::Data const &accessKey ) noexcept -> APIResult< std::pair< String, Char > >
+// Parameters
+struct Parameters
   {
-    if ( auto const strName = makeStringWithData( server, name ) )
+    Integer threshold;
+  };
+
+constexpr auto kPropertySchema = makePropertySchema< Parameters >(
+  IntegerPropertyItem< Parameters >{ kThresholdItemKey, kThresholdName, kThresholdAccessKey, kThresholdMinValue, kThresholdMaxValue, kThresholdDefaultValue, kThresholdStoreValue, &Parameters::threshold }
+);
+
+auto toTargetKind( Offscreen::ChannelOrders order ) noexcept -> APIResult< FilterInitializer::TargetKinds >
+  {
+    switch ( order )
       {
-        if ( auto const strAccessKey = makeStringWithData( server, accessKey ) )
-          {
-            if ( auto const str = strAccessKey.getLocalCodeString() )
-              {
-                if ( !str->empty() )
-                  { return std::make_pair( strName, ( *str )[ 0 ] ); }
-              }
-          }
+        case Offscreen::ChannelOrders::Alpha:
+          return FilterInitializer::TargetKinds::RasterLayerAlpha;
+        case Offscreen::ChannelOrders::GrayAlpha:
+          return FilterInitializer::TargetKinds::RasterLayerGrayAlpha;
+        case Offscreen::ChannelOrders::RGBAlpha:
+          return FilterInitializer::TargetKinds::RasterLayerRGBAlpha;
+        case Offscreen::ChannelOrders::CMYKAlpha:
+          return FilterInitializer::TargetKinds::RasterLayerCMYKAlpha;
+        case Offscreen::ChannelOrders::BinarizationAlpha:
+          return FilterInitializer::TargetKinds::RasterLayerBinarizationAlpha;
+        case Offscreen::ChannelOrders::BinarizationGrayAlpha:
+          return FilterInitializer::TargetKinds::RasterLayerBinarizationGrayAlpha;
+        case Offscreen::ChannelOrders::SelectArea:
+        case Offscreen::ChannelOrders::Plane:
+          break;
       }
-    return {};
+    return APIResults::Failed;
   }
 
 auto lerp( UInt8 a, UInt8 b, UInt8 c ) noexcept -> UInt8
@@ -91,7 +112,7 @@ class Filter
           { return CallResults::Failed; }
 
         // ModuleId
-        if ( auto const moduleId = makeStringWithData( server_, kModuleId ) )
+        if ( auto const moduleId = strings_.getString( server_, kModuleId ) )
           {
             if ( !mi.setModuleId( moduleId ) )
               { return CallResults::Failed; }
@@ -109,7 +130,7 @@ class Filter
         auto const fi = makeFilterInitializer( server_ );
 
         // CategoryName
-        if ( auto const pair = makeCaption( server_, kCategoryName, kCategoryAccessKey ) )
+        if ( auto const pair = strings_.getCaption( server_, kCategoryName, kCategoryAccessKey ) )
           {
             if ( !fi.setFilterCategoryName( pair->first, pair->second ) )
               { return CallResults::Failed; }
@@ -118,7 +139,7 @@ class Filter
           { return CallResults::Failed; }
 
         // Name
-        if ( auto const pair = makeCaption( server_, kName, kAccessKey ) )
+        if ( auto const pair = strings_.getCaption( server_, kName, kAccessKey ) )
           {
             if ( !fi.setFilterName( pair->first, pair->second ) )
               { return CallResults::Failed; }
@@ -140,21 +161,8 @@ class Filter
             if ( !fi.setCanPreview( kCanPreview ) )
               { return CallResults::Failed; }
 
-            // Threshold
-            if ( auto pair = makeCaption( server_, kThresholdName, kThresholdAccessKey ) )
-              {
-                if ( !prop.addItem( kThresholdItemKey, Property::ValueTypes::Integer, Property::ValueKinds::Default, Property::InputKinds::Default, pair->first, pair->second ) )
-                  { return CallResults::Failed; }
-                if ( !prop.setIntegerMinValue( kThresholdItemKey, kThresholdMinValue ) )
-                  { return CallResults::Failed; }
-                if ( !prop.setIntegerMaxValue( kThresholdItemKey, kThresholdMaxValue ) )
-                  { return CallResults::Failed; }
-                if ( !prop.setIntegerDefaultValue( kThresholdItemKey, kThresholdDefaultValue ) )
-                  { return CallResults::Failed; }
-                if ( !prop.setItemStoreValue( kThresholdItemKey, kThresholdStoreValue ) )
-                  { return CallResults::Failed; }
-              }
-            else
+            // Items
+            if ( !kPropertySchema.add( prop, [ this ]( String::Data const &name, String::Data const &accessKey ) { return strings_.getCaption( server_, name, accessKey ); } ) )
               { return CallResults::Failed; }
 
             // PropertyCallBack
@@ -177,120 +185,75 @@ class Filter
 
         auto const fr = makeFilterRunner( server_ );
 
-        auto const destinationOffscreen = makeOffscreenWithObject( server_, *fr.getDestinationOffscreen(), false );
-
-        std::vector< Int > channelIndexs{};
-        switch ( *destinationOffscreen.getChannelOrder() )
-          {
-            case Offscreen::ChannelOrders::Alpha:
-              if ( std::find( kTargetKinds.begin(), kTargetKinds.end(), FilterInitializer::TargetKinds::RasterLayerAlpha ) == kTargetKinds.end() )
-                { return CallResults::Failed; }
-              break;
+        auto const context = makeFilterRunContext( server_ );
+        if ( !context )
+          { return CallResults::Failed; }
 
-            case Offscreen::ChannelOrders::GrayAlpha:
-              if ( std::find( kTargetKinds.begin(), kTargetKinds.end(), FilterInitializer::TargetKinds::RasterLayerGrayAlpha ) == kTargetKinds.end() )
-                { return CallResults::Failed; }
-              channelIndexs.push_back( 0 );
-              break;
+        auto const &destinationOffscreen = context.destinationOffscreen;
+        auto const &channelIndexs = context.channelIndexs;
 
-            case Offscreen::ChannelOrders::RGBAlpha:
-              if ( std::find( kTargetKinds.begin(), kTargetKinds.end(), FilterInitializer::TargetKinds::RasterLayerRGBAlpha ) == kTargetKinds.end() )
-                { return CallResults::Failed; }
-              if ( auto const indexs = destinationOffscreen.getRGBChannelIndex() )
-                {
-                  channelIndexs.push_back( std::get< 0 >( *indexs ) );
-                  channelIndexs.push_back( std::get< 1 >( *indexs ) );
-                  channelIndexs.push_back( std::get< 2 >( *indexs ) );
-                }
-              else
-                { return CallResults::Failed; }
-              break;
+        auto const targetKind = toTargetKind( context.channelOrder );
+        if ( !targetKind || std::find( kTargetKinds.begin(), kTargetKinds.end(), *targetKind ) == kTargetKinds.end() )
+          { return CallResults::Failed; }
 
-            case Offscreen::ChannelOrders::CMYKAlpha:
-              if ( std::find( kTargetKinds.begin(), kTargetKinds.end(), FilterInitializer::TargetKinds::RasterLayerCMYKAlpha ) == kTargetKinds.end() )
-                { return CallResults::Failed; }
-              if ( auto const indexs = destinationOffscreen.getCMYKChannelIndex() )
-                {
-                  channelIndexs.push_back( std::get< 0 >( *indexs ) );
-                  channelIndexs.push_back( std::get< 1 >( *indexs ) );
-                  channelIndexs.push_back( std::get< 2 >( *indexs ) );
-                  channelIndexs.push_back( std::get< 3 >( *indexs ) );
-                }
-              else
-                { return CallResults::Failed; }
-              break;
+        if ( auto const prop = fr.getProperty() )
+          { kPropertySchema.load( makePropertyWithObject( server_, *prop, false ), parameters_ ); }
 
-            case Offscreen::ChannelOrders::BinarizationAlpha:
-              if ( std::find( kTargetKinds.begin(), kTargetKinds.end(), FilterInitializer::TargetKinds::RasterLayerBinarizationAlpha ) == kTargetKinds.end() )
-                { return CallResults::Failed; }
-              break;
+        auto const &selectAreaRect = context.selectAreaRect;
 
-            case Offscreen::ChannelOrders::BinarizationGrayAlpha:
-              if ( std::find( kTargetKinds.begin(), kTargetKinds.end(), FilterInitializer::TargetKinds::RasterLayerBinarizationGrayAlpha ) == kTargetKinds.end() )
-                { return CallResults::Failed; }
-              channelIndexs.push_back( 0 );
-              break;
+        // Nothing outside the painted extent is ever fetched
+        auto const workRect = intersectExtent( destinationOffscreen, selectAreaRect );
+        if ( !workRect )
+          { return CallResults::Failed; }
 
-            case Offscreen::ChannelOrders::SelectArea:
-            case Offscreen::ChannelOrders::Plane:
-              return CallResults::Failed;
-          }
+        BlockGrid grid{};
+        if ( !grid.make( destinationOffscreen, *workRect ) )
+          { return CallResults::Failed; }
 
-        auto const selectAreaRect = *fr.getSelectAreaRect();
+        if ( !coverage_.make( context.selectAreaOffscreen, grid ) )
+          { return CallResults::Failed; }
+        sparse_.make( selectAreaRect, grid );
 
-        auto const count = *destinationOffscreen.getBlockRectCount( selectAreaRect );
-        fr.setProgressTotal( count );
+        changes_.beginRun();
 
-        using S = FilterRunner::ProcessStates;
-        using R = FilterRunner::ProcessResults;
-        auto index = decltype( count ){};
-        for ( auto result = R::Restart; result != R::Exit; result = *fr.process( index < count ? !index ? S::Start : S::Continue : S::End ) )
+        // The coverage pass already holds every select value the kernel reads
+        auto const planes = channelIndexs.empty() ? BlockPlanes::Alpha : BlockPlanes::Image | BlockPlanes::Alpha;
+        auto range = makeBlockRange( fr, context, grid, planes, coverage_.emptyBlocks() );
+        for ( auto &&block : range )
           {
-            if ( result == R::Restart )
-              {
-                index = 0;
-                continue;
-              }
+            changes_.begin( block.rect );
 
-            auto const blockRect = *destinationOffscreen.getBlockRect( index, selectAreaRect );
-            Point const blockPos{ blockRect.left, blockRect.top };
-
-            if ( auto const blockAlpha = destinationOffscreen.getMutableBlockAlpha( blockPos ) )
+            // Pixels with zero alpha stay invisible whatever the threshold does to them
+            if ( sparse_.visit( block.index, makeImageView< UInt8 const >( block.alpha, block.rect ) ) )
               {
-                static Byte const one = toByte( 0xFF );
-                APIResult< Offscreen::Block > blockSelectArea = Offscreen::Block{ &one, 0, 0, blockAlpha->rect };
-                if ( *fr.hasSelectAreaOffscreen() )
-                  {
-                    auto const selectAreaOffscreen = makeOffscreenWithObject( server_, *fr.getSelectAreaOffscreen(), false );
-                    blockSelectArea = selectAreaOffscreen.getBlockSelectArea( blockPos );
-                  }
-                if ( blockSelectArea )
-                  {
-                    if ( channelIndexs.empty() )
-                      { executeBlock( blockRect, *blockSelectArea, *blockAlpha ); }
-                    else if ( auto const blockImage = destinationOffscreen.getMutableBlockImage( blockPos )
-                         )
-                      { executeBlock( blockRect, *blockSelectArea, *blockAlpha, *blockImage, channelIndexs ); }
-                  }
+                if ( channelIndexs.empty() )
+                  { executeBlock( block.index, makeImageView< UInt8 >( block.alpha, block.rect ) ); }
+                else
+                  { executeBlock( block.index, makeImageView< UInt8 >( block.image, block.rect ), channelIndexs ); }
               }
 
-            fr.updateDestinationOffscreenRect( blockRect );
-            ++index;
-            fr.setProgressDone( index );
+            // Blocks that were already binarized are not reported at all
+            changes_.end();
+            range.setUpdateRects( changes_.rects() );
           }
+        changes_.setUpdates( range.updates(), range.updateSeconds() );
 
-        return CallResults::Success;
+        return range.failed() ? CallResults::Failed : CallResults::Success;
       }
 
     auto terminate( std::weak_ptr< Server const > const &server ) noexcept -> CallResults
       {
         server_ = server;
+        coverage_.release();
+        sparse_.release();
+        changes_.release();
         return CallResults::Success;
       }
 
     auto moduleTerminate( std::weak_ptr< Server const > const &server ) noexcept -> CallResults
       {
         server_ = server;
+        strings_.clear();
         return CallResults::Success;
       }
 
@@ -330,71 +293,111 @@ class Filter
       }
 
     auto onValueChanged( Property const &prop, Property::ItemKey itemKey ) noexcept -> Property::CallBackResults
+      { return kPropertySchema.update( prop, itemKey, parameters_ ); }
+
+    void executeBlock( Int index, ImageView< UInt8 > const &target ) noexcept
       {
-        switch ( itemKey )
+        if ( target.pixelBytes() == 1 )
+          { executeKernel( index, ImageView< UInt8, 1 >{ target } ); }
+        else
+          { executeKernel( index, target ); }
+      }
+
+    void executeBlock( Int index, ImageView< UInt8 > const &image, std::vector< Int > const &channelIndexs ) noexcept
+      {
+        for ( auto &&i : channelIndexs )
+          { executeKernel( index, image.channel( i ) ); }
+      }
+
+    template < class TargetView >
+    void executeKernel( Int index, TargetView const &target ) noexcept
+      {
+        auto const targetStride = target.pixelStride();
+
+        auto const full = coverage_.block( index ) == Coverages::Full;
+        for ( auto y = 0; y < target.height(); ++y )
           {
-            case kThresholdItemKey:
-              if ( auto const threshold = prop.getIntegerValue( itemKey ) )
-                {
-                  if ( threshold_ != *threshold )
-                    {
-                      threshold_ = *threshold;
-                      return Property::CallBackResults::Modify;
-                    }
-                }
-              break;
+            auto const extent = sparse_.row( index, y );
+            if ( extent.right <= extent.left )
+              { continue; }
 
-            default:
-              break;
+            auto *targetPtr = target.row( y );
+
+            // Fully selected blocks never read the select area
+            if ( full )
+              {
+                thresholdSpan( y, targetPtr, targetStride, extent.left, extent.right );
+                continue;
+              }
+
+            for ( auto &&span : coverage_.row( index, y ) )
+              {
+                auto const left = std::max( span.left, extent.left );
+                auto const right = std::min( span.right, extent.right );
+                if ( right <= left )
+                  { continue; }
+                if ( span.coverage == Coverages::Full )
+                  { thresholdSpan( y, targetPtr, targetStride, left, right ); }
+                else if ( span.coverage == Coverages::Partial )
+                  { blendSpan( y, coverage_.values( span ) + ( left - span.left ), targetPtr, targetStride, left, right ); }
+              }
           }
-        return Property::CallBackResults::NoModify;
       }
 
-    void executeBlock( Rect const &blockRect, Offscreen::Block const &blockSelectArea, Offscreen::MutableBlock const &blockAlpha ) noexcept
+    // Spans compare before storing so pixels that are already binarized are never written
+    template < class Stride >
+    void thresholdSpan( Int y, UInt8 *TP_RESTRICT targetPtr, Stride targetStride, Int left, Int right ) noexcept
       {
-        for ( auto y = blockRect.top; y < blockRect.bottom; ++y )
+        auto const threshold = parameters_.threshold;
+        auto changedLeft = right;
+        auto changedRight = left;
+        auto written = 0;
+        for ( auto x = left; x < right; ++x )
           {
-            auto selectPtr = reinterpret_cast< UInt8 const * >( blockSelectArea.address + ( blockSelectArea.rowBytes * ( y - blockRect.top ) ) );
-            auto alphaPtr = reinterpret_cast< UInt8 * >( blockAlpha.address + ( blockAlpha.rowBytes * ( y - blockRect.top ) ) );
-            for ( auto x = blockRect.left; x < blockRect.right; ++x )
+            auto &t = targetPtr[ x * targetStride ];
+            UInt8 const ch = t < threshold ? 0x00 : 0xFF;
+            if ( t != ch )
               {
-                UInt8 const ch = *alphaPtr < threshold_ ? 0x00 : 0xFF;
-                if ( *selectPtr == 0xFF )
-                  { *alphaPtr = ch; }
-                else if ( *selectPtr )
-                  { *alphaPtr = lerp( *alphaPtr, ch, *selectPtr ); }
-                selectPtr += blockSelectArea.pixelBytes;
-                alphaPtr += blockAlpha.pixelBytes;
+                t = ch;
+                changedLeft = std::min( changedLeft, x );
+                changedRight = x + 1;
+                ++written;
               }
           }
+        changes_.mark( y, left, right, changedLeft, changedRight, written );
       }
 
-    void executeBlock( Rect const &blockRect, Offscreen::Block const &blockSelectArea, Offscreen::MutableBlock const &blockAlpha, Offscreen::MutableBlock const &blockImage, std::vector< Int > const &channelIndexs ) noexcept
+    // selectPtr holds the select values of [ left, right ) contiguously
+    template < class TargetStride >
+    void blendSpan( Int y, UInt8 const *TP_RESTRICT selectPtr, UInt8 *TP_RESTRICT targetPtr, TargetStride targetStride, Int left, Int right ) noexcept
       {
-        for ( auto y = blockRect.top; y < blockRect.bottom; ++y )
+        auto const threshold = parameters_.threshold;
+        auto changedLeft = right;
+        auto changedRight = left;
+        auto written = 0;
+        for ( auto x = left; x < right; ++x )
           {
-            auto selectPtr = reinterpret_cast< UInt8 const * >( blockSelectArea.address + ( blockSelectArea.rowBytes * ( y - blockRect.top ) ) );
-            auto alphaPtr = reinterpret_cast< UInt8 * >( blockAlpha.address + ( blockAlpha.rowBytes * ( y - blockRect.top ) ) );
-            auto imagePtr = reinterpret_cast< UInt8 * >( blockImage.address + ( blockImage.rowBytes * ( y - blockRect.top ) ) );
-            for ( auto x = blockRect.left; x < blockRect.right; ++x )
+            auto const s = selectPtr[ x - left ];
+            auto &t = targetPtr[ x * targetStride ];
+            UInt8 const ch = t < threshold ? 0x00 : 0xFF;
+            auto const value = lerp( t, ch, s );
+            if ( t != value )
               {
-                for ( auto &&i : channelIndexs )
-                  {
-                    UInt8 const ch = imagePtr[ i ] < threshold_ ? 0x00 : 0xFF;
-                    if ( *selectPtr == 0xFF )
-                      { imagePtr[ i ] = ch; }
-                    else if ( *selectPtr )
-                      { imagePtr[ i ] = lerp( imagePtr[ i ], ch, *selectPtr ); }
-                  }
-                selectPtr += blockSelectArea.pixelBytes;
-                alphaPtr += blockAlpha.pixelBytes;
-                imagePtr += blockImage.pixelBytes;
+                t = value;
+                changedLeft = std::min( changedLeft, x );
+                changedRight = x + 1;
+                ++written;
               }
           }
+        changes_.mark( y, left, right, changedLeft, changedRight, written );
       }
 
     std::weak_ptr< Server const > server_;
-    Integer threshold_;
+    StringCache strings_;
+    SelectionCoverage coverage_;
+    SparseContent sparse_;
+    ChangeTracker changes_;
+    Parameters parameters_ = kPropertySchema.defaults();
   };
 
 } // namespace
@@ -0,0 +1,296 @@
+/// \file arena.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_arena_hh_
+#define cspsdkxx_triglavpluginsdk_arena_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined( __linux__ )
+# include <sys/mman.h>
+#endif // defined( __linux__ )
+
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+constexpr std::size_t kCacheLineBytes = 64;
+constexpr std::size_t kHugePageBytes = 2 * 1024 * 1024;
+
+
+struct ArenaOptions
+  {
+    std::size_t chunkBytes = 256 * 1024;
+    bool hugePages = false;
+  };
+
+struct ArenaStatistics
+  {
+    std::size_t allocations;
+    std::size_t allocatedBytes;
+    std::size_t peakBytes;
+    std::size_t reservedBytes;
+    std::size_t chunks;
+    std::size_t resets;
+
+    auto operator +=( ArenaStatistics const &x ) noexcept -> ArenaStatistics &
+      {
+        allocations += x.allocations;
+        allocatedBytes += x.allocatedBytes;
+        peakBytes += x.peakBytes;
+        reservedBytes += x.reservedBytes;
+        chunks += x.chunks;
+        resets += x.resets;
+        return *this;
+      }
+  };
+
+
+class MonotonicArena
+  {
+  public:
+    ~MonotonicArena() = default;
+    MonotonicArena() noexcept : MonotonicArena{ ArenaOptions{} } {}
+    MonotonicArena( MonotonicArena const & ) = delete;
+    MonotonicArena( MonotonicArena && ) = default;
+    auto operator =( MonotonicArena const & ) -> MonotonicArena & = delete;
+    auto operator =( MonotonicArena && ) -> MonotonicArena & = default;
+
+    explicit MonotonicArena( ArenaOptions const &options ) noexcept
+      : options_{ options }, chunks_{}, current_{}, offset_{}, statistics_{}
+      {
+        if ( options_.hugePages )
+          { options_.chunkBytes = roundUp( options_.chunkBytes, kHugePageBytes ); }
+      }
+
+    auto allocate( std::size_t bytes, std::size_t alignment = kCacheLineBytes ) noexcept -> void *
+      {
+        TP_ASSERT( alignment && !( alignment & ( alignment - 1 ) ) && alignment <= chunkAlignment() );
+        if ( !bytes )
+          { bytes = 1; }
+
+        for ( ; current_ < chunks_.size(); ++current_, offset_ = 0 )
+          {
+            auto const &chunk = chunks_[ current_ ];
+            auto const offset = roundUp( offset_, alignment );
+            if ( offset <= chunk.bytes && bytes <= chunk.bytes - offset )
+              { return commit( chunk, offset, bytes ); }
+          }
+
+        auto const chunkBytes = std::max( options_.chunkBytes, roundUp( bytes, chunkAlignment() ) );
+        auto chunk = Chunk::make( chunkBytes, chunkAlignment(), options_.hugePages );
+        if ( !chunk.address )
+          { return nullptr; }
+
+        statistics_.reservedBytes += chunk.bytes;
+        ++statistics_.chunks;
+        chunks_.push_back( std::move( chunk ) );
+        current_ = chunks_.size() - 1;
+        offset_ = 0;
+        return commit( chunks_.back(), 0, bytes );
+      }
+
+    template < class T >
+    auto allocate( std::size_t count ) noexcept -> T *
+      {
+        if ( count > std::numeric_limits< std::size_t >::max() / sizeof( T ) )
+          { return nullptr; }
+        return static_cast< T * >( allocate( sizeof( T ) * count, alignof( T ) > kCacheLineBytes ? alignof( T ) : kCacheLineBytes ) );
+      }
+
+    void reset() noexcept
+      {
+        current_ = 0;
+        offset_ = 0;
+        statistics_.allocatedBytes = 0;
+        ++statistics_.resets;
+      }
+
+    void release() noexcept
+      {
+        chunks_.clear();
+        current_ = 0;
+        offset_ = 0;
+        statistics_ = ArenaStatistics{};
+      }
+
+    auto statistics() const noexcept -> ArenaStatistics const &
+      { return statistics_; }
+
+  private:
+    struct Chunk
+      {
+        struct Deleter
+          {
+            void operator ()( Byte *x ) const noexcept
+              {
+                ::operator delete( x );
+                MemoryAccounting::instance().deallocate( MemoryCategories::Scratch, bytes );
+              }
+
+            std::size_t bytes;
+          };
+
+        static auto make( std::size_t bytes, std::size_t alignment, bool hugePages ) noexcept -> Chunk
+          {
+            Chunk result{};
+            auto const storage = static_cast< Byte * >( ::operator new( bytes + alignment, std::nothrow ) );
+            if ( !storage )
+              { return result; }
+
+            MemoryAccounting::instance().allocate( MemoryCategories::Scratch, bytes + alignment );
+            result.storage = std::unique_ptr< Byte, Deleter >{ storage, Deleter{ bytes + alignment } };
+
+            auto const address = reinterpret_cast< std::uintptr_t >( result.storage.get() );
+            result.address = result.storage.get() + ( roundUp( address, alignment ) - address );
+            result.bytes = bytes;
+#if defined( __linux__ ) && defined( MADV_HUGEPAGE )
+            if ( hugePages )
+              { ::madvise( result.address, bytes, MADV_HUGEPAGE ); }
+#else
+            static_cast< void >( hugePages );
+#endif // defined( __linux__ ) && defined( MADV_HUGEPAGE )
+            return result;
+          }
+
+        std::unique_ptr< Byte, Deleter > storage;
+        Byte *address;
+        std::size_t bytes;
+      };
+
+    static constexpr auto roundUp( std::size_t x, std::size_t alignment ) noexcept -> std::size_t
+      { return ( x + alignment - 1 ) / alignment * alignment; }
+
+    auto chunkAlignment() const noexcept -> std::size_t
+      { return options_.hugePages ? kHugePageBytes : kCacheLineBytes; }
+
+    auto commit( Chunk const &chunk, std::size_t offset, std::size_t bytes ) noexcept -> void *
+      {
+        offset_ = offset + bytes;
+        ++statistics_.allocations;
+        statistics_.allocatedBytes += bytes;
+        statistics_.peakBytes = std::max( statistics_.peakBytes, statistics_.allocatedBytes );
+        return chunk.address + offset;
+      }
+
+    ArenaOptions options_;
+    std::vector< Chunk > chunks_;
+    std::size_t current_;
+    std::size_t offset_;
+    ArenaStatistics statistics_;
+  };
+
+
+class RunArena
+  {
+  public:
+    ~RunArena() = default;
+    RunArena() : RunArena{ 1, ArenaOptions{} } {}
+    RunArena( RunArena const & ) = delete;
+    RunArena( RunArena && ) = default;
+    auto operator =( RunArena const & ) -> RunArena & = delete;
+    auto operator =( RunArena && ) -> RunArena & = default;
+
+    RunArena( std::size_t threads, ArenaOptions const &options )
+      : arenas_{}
+      {
+        TP_ASSERT( threads > 0 );
+        arenas_.reserve( threads );
+        for ( std::size_t i = 0; i < threads; ++i )
+          { arenas_.emplace_back( std::make_unique< MonotonicArena >( options ) ); }
+      }
+
+    auto threads() const noexcept -> std::size_t
+      { return arenas_.size(); }
+
+    auto local( std::size_t thread = 0 ) noexcept -> MonotonicArena &
+      {
+        TP_ASSERT( thread < arenas_.size() );
+        return *arenas_[ thread ];
+      }
+
+    void reset() noexcept
+      {
+        for ( auto &&x : arenas_ )
+          { x->reset(); }
+      }
+
+    void release() noexcept
+      {
+        for ( auto &&x : arenas_ )
+          { x->release(); }
+      }
+
+    auto statistics() const noexcept -> ArenaStatistics
+      {
+        ArenaStatistics result{};
+        for ( auto &&x : arenas_ )
+          { result += x->statistics(); }
+        return result;
+      }
+
+  private:
+    std::vector< std::unique_ptr< MonotonicArena > > arenas_;
+  };
+
+
+template < class T >
+class ArenaAllocator
+  {
+  public:
+    template < class Y > friend class ArenaAllocator;
+
+    using value_type = T;
+
+    ~ArenaAllocator() = default;
+    ArenaAllocator() = delete;
+    ArenaAllocator( ArenaAllocator const & ) = default;
+    ArenaAllocator( ArenaAllocator && ) = default;
+    auto operator =( ArenaAllocator const & ) -> ArenaAllocator & = default;
+    auto operator =( ArenaAllocator && ) -> ArenaAllocator & = default;
+
+    constexpr ArenaAllocator( MonotonicArena &arena ) noexcept : arena_{ &arena } {}
+
+    template < class Y >
+    constexpr ArenaAllocator( ArenaAllocator< Y > const &x ) noexcept : arena_{ x.arena_ } {}
+
+    auto allocate( std::size_t count ) -> T *
+      {
+        if ( auto const result = arena_->allocate< T >( count ) )
+          { return result; }
+        throw std::bad_alloc{};
+      }
+
+    void deallocate( T *, std::size_t ) noexcept {}
+
+    auto arena() const noexcept -> MonotonicArena &
+      { return *arena_; }
+
+    template < class Y >
+    auto operator ==( ArenaAllocator< Y > const &x ) const noexcept -> bool
+      { return arena_ == x.arena_; }
+
+    template < class Y >
+    auto operator !=( ArenaAllocator< Y > const &x ) const noexcept -> bool
+      { return arena_ != x.arena_; }
+
+  private:
+    MonotonicArena *arena_;
+  };
+
+template < class T >
+using ArenaVector = std::vector< T, ArenaAllocator< T > >;
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_arena_hh_
@@ -0,0 +1,167 @@
+/// \file changetracker.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_changetracker_hh_
+#define cspsdkxx_triglavpluginsdk_changetracker_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+struct WriteStatistics
+  {
+    std::size_t visitedBytes;
+    std::size_t writtenBytes;
+    Int blocks;
+    Int changedBlocks;
+    std::size_t rects;
+    Int updates;
+    double updateSeconds;
+  };
+
+
+// Collects what the kernels of one block actually changed, so only that is reported to the host
+class ChangeTracker
+  {
+  public:
+    constexpr static std::size_t kMaxRects = BlockRange::kMaxUpdateRects;
+
+    ~ChangeTracker() = default;
+    ChangeTracker() = default;
+    ChangeTracker( ChangeTracker const & ) = delete;
+    ChangeTracker( ChangeTracker && ) = default;
+    auto operator =( ChangeTracker const & ) -> ChangeTracker & = delete;
+    auto operator =( ChangeTracker && ) -> ChangeTracker & = default;
+
+    void beginRun() noexcept
+      { statistics_ = WriteStatistics{}; }
+
+    void release() noexcept
+      { *this = ChangeTracker{}; }
+
+    void begin( Rect const &rect )
+      {
+        rect_ = rect;
+        rows_.assign( static_cast< std::size_t >( rect.bottom - rect.top ), RowChange{ rect.right - rect.left, 0 } );
+        rects_.clear();
+        left_ = rect.right - rect.left;
+        right_ = 0;
+        top_ = rect.bottom - rect.top;
+        bottom_ = 0;
+        ++statistics_.blocks;
+      }
+
+    // Records a visit of [ left, right ) on row y, all relative to the block, of which [ changedLeft, changedRight ) was written
+    void mark( Int y, Int left, Int right, Int changedLeft, Int changedRight, Int written ) noexcept
+      {
+        statistics_.visitedBytes += static_cast< std::size_t >( right - left );
+        if ( changedRight <= changedLeft )
+          { return; }
+        statistics_.writtenBytes += static_cast< std::size_t >( written );
+        auto &row = rows_[ static_cast< std::size_t >( y ) ];
+        row.left = std::min( row.left, changedLeft );
+        row.right = std::max( row.right, changedRight );
+        left_ = std::min( left_, changedLeft );
+        right_ = std::max( right_, changedRight );
+        top_ = std::min( top_, y );
+        bottom_ = std::max( bottom_, y + 1 );
+      }
+
+    // Finishes the block and returns the bounds of what changed; it is empty when nothing changed
+    auto end() -> Rect
+      {
+        rects_.clear();
+        if ( !changed() )
+          { return Rect{ rect_.left, rect_.top, rect_.left, rect_.top }; }
+        ++statistics_.changedBlocks;
+
+        // One rect per run of changed rows, so unchanged rows between them are not reported
+        auto const bounds = Rect{ rect_.left + left_, rect_.top + top_, rect_.left + right_, rect_.top + bottom_ };
+        for ( auto y = top_; y < bottom_; ++y )
+          {
+            auto const &row = rows_[ static_cast< std::size_t >( y ) ];
+            if ( row.right <= row.left )
+              { continue; }
+            Rect const x{ rect_.left + row.left, rect_.top + y, rect_.left + row.right, rect_.top + y + 1 };
+            if ( !rects_.empty() && rects_.back().bottom == x.top )
+              { rects_.back() = unite( rects_.back(), x ); }
+            else if ( rects_.size() < kMaxRects )
+              { rects_.push_back( x ); }
+            else
+              {
+                rects_.assign( 1, bounds );
+                break;
+              }
+          }
+        statistics_.rects += rects_.size();
+        return bounds;
+      }
+
+    // The rects finished by the last end(), to report in place of its bounds
+    auto rects() const noexcept -> AccountedVector< Rect > const &
+      { return rects_; }
+
+    auto changed() const noexcept -> bool
+      { return left_ < right_; }
+
+    auto rowChanged( Int y ) const noexcept -> bool
+      {
+        auto const &row = rows_[ static_cast< std::size_t >( y ) ];
+        return row.left < row.right;
+      }
+
+    void setUpdates( Int updates, double seconds ) noexcept
+      {
+        statistics_.updates = updates;
+        statistics_.updateSeconds = seconds;
+      }
+
+    auto statistics() const noexcept -> WriteStatistics const &
+      { return statistics_; }
+
+    auto report() const -> std::string
+      {
+        auto const &x = statistics_;
+        char line[ 160 ]{};
+        std::snprintf( line, sizeof( line ), "%-8s visited %zu written %zu blocks %d changed %d rects %zu updates %d ( %.3f ms )\n", "writes", x.visitedBytes, x.writtenBytes, static_cast< int >( x.blocks ), static_cast< int >( x.changedBlocks ), x.rects, static_cast< int >( x.updates ), x.updateSeconds * 1000.0 );
+        return line;
+      }
+
+  private:
+    struct RowChange
+      {
+        Int left;
+        Int right;
+      };
+
+    Rect rect_{};
+    AccountedVector< RowChange > rows_{};
+    AccountedVector< Rect > rects_{};
+    Int left_{};
+    Int right_{};
+    Int top_{};
+    Int bottom_{};
+    WriteStatistics statistics_{};
+  };
+
+
+inline void logWriteStatistics( ChangeTracker const &tracker )
+  {
+#if !defined( NDEBUG )
+    TP_LOG( tracker.report().c_str() );
+#endif // !defined( NDEBUG )
+  }
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_changetracker_hh_
@@ -0,0 +1,285 @@
+/// \file halofetcher.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_halofetcher_hh_
+#define cspsdkxx_triglavpluginsdk_halofetcher_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+enum class HaloSources : UInt8
+  {
+    Blocks,
+    Bitmap,
+  };
+
+struct HaloTile
+  {
+    Rect rect;
+    Rect haloRect;
+    Int radius;
+    ImageView< UInt8 > view;
+
+    auto inner() const noexcept -> ImageView< UInt8 >
+      { return view.sub( rect.left - haloRect.left, rect.top - haloRect.top, rect.right - rect.left, rect.bottom - rect.top ); }
+
+    auto pixel( Int x, Int y ) const noexcept -> UInt8 *
+      { return view.pixel( x - haloRect.left, y - haloRect.top ); }
+  };
+
+// Fills the pixels of view, which covers viewRect, that lie outside valid from the pixels inside it
+inline void padEdges( ImageView< UInt8 > const &view, Rect const &viewRect, Rect const &valid, EdgePolicies policy ) noexcept
+  {
+    auto const bytes = static_cast< std::size_t >( view.pixelBytes() );
+    auto const pixel = [ & ]( Int x, Int y ) { return view.pixel( x - viewRect.left, y - viewRect.top ); };
+    auto const fill = [ & ]( UInt8 *destination, UInt8 const *source, std::size_t n )
+      {
+        if ( policy == EdgePolicies::Transparent )
+          { std::memset( destination, 0, n ); }
+        else
+          { std::memcpy( destination, source, n ); }
+      };
+
+    for ( auto y = valid.top; y < valid.bottom; ++y )
+      {
+        for ( auto x = viewRect.left; x < valid.left; ++x )
+          { fill( pixel( x, y ), pixel( mapEdge( policy, x, valid.left, valid.right ), y ), bytes ); }
+        for ( auto x = valid.right; x < viewRect.right; ++x )
+          { fill( pixel( x, y ), pixel( mapEdge( policy, x, valid.left, valid.right ), y ), bytes ); }
+      }
+
+    auto const rowBytes = static_cast< std::size_t >( viewRect.right - viewRect.left ) * bytes;
+    for ( auto y = viewRect.top; y < valid.top; ++y )
+      { fill( pixel( viewRect.left, y ), pixel( viewRect.left, mapEdge( policy, y, valid.top, valid.bottom ) ), rowBytes ); }
+    for ( auto y = valid.bottom; y < viewRect.bottom; ++y )
+      { fill( pixel( viewRect.left, y ), pixel( viewRect.left, mapEdge( policy, y, valid.top, valid.bottom ) ), rowBytes ); }
+  }
+
+struct HaloFetcherStatistics
+  {
+    std::size_t tiles;
+    std::size_t fetchedPixels;
+    std::size_t reusedPixels;
+  };
+
+
+// The columns shared with the previous tile are copied from it instead of refetched, so the source must not be
+// written while the fetcher is in use; a caller that does write reports each written rect through invalidate( rect )
+class HaloFetcher
+  {
+  public:
+    ~HaloFetcher() = default;
+    HaloFetcher() = default;
+    HaloFetcher( HaloFetcher const & ) = delete;
+    HaloFetcher( HaloFetcher && ) = default;
+    auto operator =( HaloFetcher const & ) -> HaloFetcher & = delete;
+    auto operator =( HaloFetcher && ) -> HaloFetcher & = default;
+
+    auto make( std::weak_ptr< Server const > const &server, Offscreen const &offscreen, BlockPlanes plane, Int radius, EdgePolicies policy, HaloSources source = HaloSources::Blocks ) -> APIResult< void >
+      {
+        TP_ASSERT( plane == BlockPlanes::Image || plane == BlockPlanes::Alpha );
+        TP_ASSERT( radius >= 0 );
+
+        auto const rect = offscreen.getRect();
+        if ( !rect )
+          { return APIResults::Failed; }
+
+        BlockGrid grid{};
+        if ( !grid.make( offscreen, *rect ) )
+          { return APIResults::Failed; }
+
+        offscreen_ = offscreen;
+        grid_ = grid;
+        plane_ = plane;
+        radius_ = radius;
+        policy_ = policy;
+        source_ = source;
+
+        auto const block = fetchBlock( 0 );
+        if ( !block )
+          { return APIResults::Failed; }
+        pixelBytes_ = block->pixelBytes;
+
+        auto const first = grid_.rect( 0 );
+        maxWidth_ = first.right - first.left + radius_ * 2;
+        maxHeight_ = first.bottom - first.top + radius_ * 2;
+        for ( auto &&x : buffers_ )
+          { x.assign( static_cast< std::size_t >( maxWidth_ * maxHeight_ * pixelBytes_ ), 0 ); }
+
+        if ( source_ == HaloSources::Bitmap )
+          {
+            bitmap_ = makeBitmap( server, maxWidth_, maxHeight_, pixelBytes_, Bitmap::Scanlines::HorizontalLeftTop );
+            if ( !bitmap_ )
+              { return APIResults::Failed; }
+          }
+
+        invalidate();
+        statistics_ = HaloFetcherStatistics{};
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( grid_ ); }
+
+    auto radius() const noexcept -> Int
+      { return radius_; }
+
+    auto policy() const noexcept -> EdgePolicies
+      { return policy_; }
+
+    // Pixels outside bounds are padded according to policy
+    auto bounds() const noexcept -> Rect const &
+      { return grid_.bounds(); }
+
+    auto pixelBytes() const noexcept -> Int
+      { return pixelBytes_; }
+
+    auto statistics() const noexcept -> HaloFetcherStatistics const &
+      { return statistics_; }
+
+    void invalidate() noexcept
+      { tile_ = HaloTile{}; }
+
+    // Drops the previous tile if written overlaps it, so its stale pixels are never reused
+    void invalidate( Rect const &written ) noexcept
+      {
+        if ( tile_.view && !isEmpty( intersect( tile_.haloRect, written ) ) )
+          { invalidate(); }
+      }
+
+    auto fetch( Rect const &rect ) -> APIResult< HaloTile >
+      {
+        HaloTile tile{};
+        tile.rect = rect;
+        tile.haloRect = Rect{ rect.left - radius_, rect.top - radius_, rect.right + radius_, rect.bottom + radius_ };
+        tile.radius = radius_;
+
+        auto const width = tile.haloRect.right - tile.haloRect.left;
+        auto const height = tile.haloRect.bottom - tile.haloRect.top;
+        if ( width > maxWidth_ || height > maxHeight_ )
+          { return APIResults::Failed; }
+
+        auto const valid = intersect( tile.haloRect, grid_.bounds() );
+        if ( isEmpty( valid ) )
+          { return APIResults::Failed; }
+
+        current_ ^= 1;
+        auto &buffer = buffers_[ current_ ];
+        tile.view = ImageView< UInt8 >{ reinterpret_cast< Byte * >( buffer.data() ), width * pixelBytes_, pixelBytes_, width, height };
+
+        auto fetchLeft = valid.left;
+
+        // Reuse the columns shared with the previous tile in the same block row
+        auto const &previous = tile_;
+        if ( previous.view && previous.haloRect.top == tile.haloRect.top && previous.haloRect.bottom == tile.haloRect.bottom )
+          {
+            auto const left = std::max( valid.left, previous.haloRect.left );
+            auto const right = std::min( valid.right, previous.haloRect.right );
+            if ( left == valid.left && left < right )
+              {
+                auto const bytes = static_cast< std::size_t >( ( right - left ) * pixelBytes_ );
+                for ( auto y = valid.top; y < valid.bottom; ++y )
+                  { std::memcpy( tile.pixel( left, y ), previous.pixel( left, y ), bytes ); }
+                statistics_.reusedPixels += area( Rect{ left, valid.top, right, valid.bottom } );
+                fetchLeft = right;
+              }
+          }
+
+        if ( fetchLeft < valid.right )
+          {
+            Rect const region{ fetchLeft, valid.top, valid.right, valid.bottom };
+            if ( !( source_ == HaloSources::Bitmap ? fetchFromBitmap( tile, region ) : fetchFromBlocks( tile, region ) ) )
+              {
+                invalidate();
+                return APIResults::Failed;
+              }
+            statistics_.fetchedPixels += area( region );
+          }
+
+        padEdges( tile.view, tile.haloRect, valid, policy_ );
+        ++statistics_.tiles;
+        tile_ = tile;
+        return tile;
+      }
+
+  private:
+    auto fetchBlock( Int index ) const noexcept -> APIResult< Offscreen::Block >
+      {
+        auto const rect = grid_.rect( index );
+        Point const pos{ rect.left, rect.top };
+        return plane_ == BlockPlanes::Image ? offscreen_.getBlockImage( pos ) : offscreen_.getBlockAlpha( pos );
+      }
+
+    auto fetchFromBlocks( HaloTile const &tile, Rect const &region ) const noexcept -> bool
+      {
+        auto const first = grid_.indexAt( Point{ region.left, region.top } );
+        auto const last = grid_.indexAt( Point{ region.right - 1, region.bottom - 1 } );
+        for ( auto row = grid_.row( first ); row <= grid_.row( last ); ++row )
+          {
+            for ( auto column = grid_.column( first ); column <= grid_.column( last ); ++column )
+              {
+                auto const index = grid_.index( column, row );
+                auto const block = fetchBlock( index );
+                if ( !block || block->pixelBytes != pixelBytes_ )
+                  { return false; }
+
+                auto const rect = grid_.rect( index );
+                auto const r = intersect( rect, region );
+                auto const source = makeImageView< UInt8 >( *block, rect );
+                auto const bytes = static_cast< std::size_t >( ( r.right - r.left ) * pixelBytes_ );
+                for ( auto y = r.top; y < r.bottom; ++y )
+                  { std::memcpy( tile.pixel( r.left, y ), source.pixel( r.left - rect.left, y - rect.top ), bytes ); }
+              }
+          }
+        return true;
+      }
+
+    auto fetchFromBitmap( HaloTile const &tile, Rect const &region ) const noexcept -> bool
+      {
+        auto const width = region.right - region.left;
+        auto const height = region.bottom - region.top;
+        auto const mode = plane_ == BlockPlanes::Image ? Offscreen::CopyModes::Image : Offscreen::CopyModes::Alpha;
+        if ( !offscreen_.getBitmap( bitmap_, Point{ 0, 0 }, Point{ region.left, region.top }, width, height, mode ) )
+          { return false; }
+
+        auto const source = makeImageView< UInt8 const >( bitmap_ );
+        if ( !source || source->pixelBytes() != pixelBytes_ )
+          { return false; }
+
+        auto const bytes = static_cast< std::size_t >( width * pixelBytes_ );
+        for ( auto y = 0; y < height; ++y )
+          { std::memcpy( tile.pixel( region.left, region.top + y ), source->row( y ), bytes ); }
+        return true;
+      }
+
+    Offscreen offscreen_{};
+    Bitmap bitmap_{};
+    BlockGrid grid_{};
+    BlockPlanes plane_{};
+    Int radius_{};
+    EdgePolicies policy_{};
+    HaloSources source_{};
+    Int pixelBytes_{};
+    Int maxWidth_{};
+    Int maxHeight_{};
+    std::vector< UInt8 > buffers_[ 2 ]{};
+    Int current_{};
+    HaloTile tile_{};
+    HaloFetcherStatistics statistics_{};
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_halofetcher_hh_
@@ -0,0 +1,292 @@
+/// \file imagepyramid.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_imagepyramid_hh_
+#define cspsdkxx_triglavpluginsdk_imagepyramid_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+enum class PyramidFilters : UInt8
+  {
+    Box,
+    Binomial,
+  };
+
+
+// Downsampled copies of one plane of a source offscreen; level n pixel ( x, y ) covers 2^n x 2^n source pixels
+class ImagePyramid
+  {
+  public:
+    constexpr static Int kMaxLevels = 16;
+
+    ~ImagePyramid() = default;
+    ImagePyramid() = default;
+    ImagePyramid( ImagePyramid const & ) = delete;
+    ImagePyramid( ImagePyramid && ) = default;
+    auto operator =( ImagePyramid const & ) -> ImagePyramid & = delete;
+    auto operator =( ImagePyramid && ) -> ImagePyramid & = default;
+
+    // Only records the source; levels are built on first use
+    auto make( Offscreen const &source, BlockPlanes plane, PyramidFilters filter = PyramidFilters::Box ) -> APIResult< void >
+      {
+        TP_ASSERT( plane == BlockPlanes::Image || plane == BlockPlanes::Alpha );
+
+        invalidate();
+
+        auto const rect = source.getRect();
+        if ( !rect )
+          { return APIResults::Failed; }
+
+        BlockGrid grid{};
+        if ( !grid.make( source, *rect ) || !grid )
+          { return APIResults::Failed; }
+
+        source_ = source;
+        grid_ = grid;
+        plane_ = plane;
+        filter_ = filter;
+
+        auto const first = grid_.rect( 0 );
+        auto const block = fetchBlock( first );
+        if ( !block )
+          { return APIResults::Failed; }
+        pixelBytes_ = block->pixelBytes;
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( grid_ ); }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto pixelBytes() const noexcept -> Int
+      { return pixelBytes_; }
+
+    // Number of levels above the source, down to a single pixel
+    auto levels() const noexcept -> Int
+      {
+        auto const &r = grid_.bounds();
+        auto n = Int{};
+        for ( auto size = std::max( r.right - r.left, r.bottom - r.top ); size > 1 && n < kMaxLevels; size = ( size + 1 ) / 2 )
+          { ++n; }
+        return n;
+      }
+
+    // Size of level n in its own pixels; level 0 is the source
+    auto size( Int n ) const noexcept -> Point
+      {
+        auto const &r = grid_.bounds();
+        Point x{ r.right - r.left, r.bottom - r.top };
+        for ( auto i = 0; i < n; ++i )
+          { x = Point{ ( x.x + 1 ) / 2, ( x.y + 1 ) / 2 }; }
+        return x;
+      }
+
+    // Builds every missing level up to n, each from the one below it
+    auto level( Int n ) -> APIResult< ConstImageView< UInt8 > >
+      {
+        if ( n < 1 || levels() < n )
+          { return APIResults::Failed; }
+
+        while ( static_cast< Int >( levels_.size() ) < n )
+          {
+            auto const i = static_cast< Int >( levels_.size() ) + 1;
+            auto const s = size( i );
+            Level x{ s.x, s.y, AccountedVector< UInt8, MemoryCategories::Caches >( static_cast< std::size_t >( s.x ) * static_cast< std::size_t >( s.y ) * static_cast< std::size_t >( pixelBytes_ ) ) };
+            if ( i == 1 )
+              {
+                if ( !buildFromSource( x ) )
+                  { return APIResults::Failed; }
+              }
+            else
+              {
+                auto const &below = levels_.back();
+                auto const rowBytes = static_cast< std::size_t >( below.width * pixelBytes_ );
+                downsample( below.width, below.height, x, [ & ]( Int y ) { return below.pixels.data() + static_cast< std::size_t >( y ) * rowBytes; } );
+              }
+            levels_.push_back( std::move( x ) );
+          }
+
+        auto &x = levels_[ static_cast< std::size_t >( n - 1 ) ];
+        return ConstImageView< UInt8 >{ reinterpret_cast< Byte const * >( x.pixels.data() ), x.width * pixelBytes_, pixelBytes_, x.width, x.height };
+      }
+
+    void invalidate() noexcept
+      { levels_.clear(); }
+
+    // Source rect covered by levelRect of level n, clipped to the source
+    auto toSource( Int n, Rect const &levelRect ) const noexcept -> Rect
+      {
+        auto const &r = grid_.bounds();
+        auto const scale = Int{ 1 } << n;
+        return Rect{
+          std::max( r.left, r.left + levelRect.left * scale ),
+          std::max( r.top, r.top + levelRect.top * scale ),
+          std::min( r.right, r.left + levelRect.right * scale ),
+          std::min( r.bottom, r.top + levelRect.bottom * scale ),
+        };
+      }
+
+    // Smallest rect of level n that covers sourceRect
+    auto toLevel( Int n, Rect const &sourceRect ) const noexcept -> Rect
+      {
+        auto const &r = grid_.bounds();
+        auto const mask = ( Int{ 1 } << n ) - 1;
+        return Rect{ ( sourceRect.left - r.left ) >> n, ( sourceRect.top - r.top ) >> n, ( sourceRect.right - r.left + mask ) >> n, ( sourceRect.bottom - r.top + mask ) >> n };
+      }
+
+    // Indices into grid() of the source blocks under levelRect of level n
+    auto blocks( Int n, Rect const &levelRect ) const -> std::vector< Int >
+      {
+        std::vector< Int > result{};
+        auto const x = toSource( n, levelRect );
+        if ( isEmpty( x ) )
+          { return result; }
+
+        auto const first = grid_.indexAt( Point{ x.left, x.top } );
+        auto const last = grid_.indexAt( Point{ x.right - 1, x.bottom - 1 } );
+        for ( auto row = grid_.row( first ); row <= grid_.row( last ); ++row )
+          {
+            for ( auto column = grid_.column( first ); column <= grid_.column( last ); ++column )
+              { result.push_back( grid_.index( column, row ) ); }
+          }
+        return result;
+      }
+
+  private:
+    struct Level
+      {
+        Int width;
+        Int height;
+        AccountedVector< UInt8, MemoryCategories::Caches > pixels;
+      };
+
+    auto fetchBlock( Rect const &rect ) const noexcept -> APIResult< Offscreen::Block >
+      {
+        Point const pos{ rect.left, rect.top };
+        return plane_ == BlockPlanes::Image ? source_.getBlockImage( pos ) : source_.getBlockAlpha( pos );
+      }
+
+    // Streams the source one block row at a time, assembling full rows into a small ring
+    auto buildFromSource( Level &x ) -> bool
+      {
+        auto const &r = grid_.bounds();
+        auto const width = r.right - r.left;
+        auto const height = r.bottom - r.top;
+        auto const rowBytes = static_cast< std::size_t >( width * pixelBytes_ );
+
+        std::vector< UInt8 > ring( rowBytes * kRingRows );
+        Int ringRows[ kRingRows ]{ -1, -1, -1, -1 };
+        std::vector< Offscreen::Block > blocks{};
+        auto blockRow = -1;
+        auto failed = false;
+
+        auto const rowOf = [ & ]( Int y ) -> UInt8 const *
+          {
+            auto *row = ring.data() + static_cast< std::size_t >( y % kRingRows ) * rowBytes;
+            if ( ringRows[ y % kRingRows ] == y )
+              { return row; }
+
+            auto const sy = r.top + y;
+            auto const current = grid_.row( grid_.indexAt( Point{ r.left, sy } ) );
+            if ( current != blockRow )
+              {
+                blocks.clear();
+                for ( auto column = 0; column < grid_.columns(); ++column )
+                  {
+                    auto const block = fetchBlock( grid_.rect( column, current ) );
+                    if ( !block || block->pixelBytes != pixelBytes_ )
+                      {
+                        failed = true;
+                        return row;
+                      }
+                    blocks.push_back( *block );
+                  }
+                blockRow = current;
+              }
+
+            for ( auto column = 0; column < grid_.columns(); ++column )
+              {
+                auto const rect = grid_.rect( column, current );
+                auto const view = makeImageView< UInt8 const >( blocks[ static_cast< std::size_t >( column ) ], rect );
+                std::memcpy( row + static_cast< std::size_t >( ( rect.left - r.left ) * pixelBytes_ ), view.row( sy - rect.top ), static_cast< std::size_t >( ( rect.right - rect.left ) * pixelBytes_ ) );
+              }
+            ringRows[ y % kRingRows ] = y;
+            return row;
+          };
+
+        downsample( width, height, x, rowOf );
+        return !failed;
+      }
+
+    template < class RowOf >
+    void downsample( Int width, Int height, Level &x, RowOf &&rowOf ) const noexcept
+      {
+        auto const bytes = pixelBytes_;
+        auto const outBytes = static_cast< std::size_t >( x.width * bytes );
+        for ( auto y = 0; y < x.height; ++y )
+          {
+            auto *TP_RESTRICT out = x.pixels.data() + static_cast< std::size_t >( y ) * outBytes;
+            auto const y0 = y * 2;
+            auto const y1 = std::min( y0 + 1, height - 1 );
+            if ( filter_ == PyramidFilters::Box )
+              {
+                auto const *TP_RESTRICT a = rowOf( y0 );
+                auto const *TP_RESTRICT b = rowOf( y1 );
+                for ( auto i = 0; i < x.width; ++i )
+                  {
+                    auto const l = i * 2 * bytes;
+                    auto const rr = std::min( i * 2 + 1, width - 1 ) * bytes;
+                    for ( auto c = 0; c < bytes; ++c )
+                      { out[ i * bytes + c ] = static_cast< UInt8 >( ( a[ l + c ] + a[ rr + c ] + b[ l + c ] + b[ rr + c ] + 2 ) >> 2 ); }
+                  }
+              }
+            else
+              {
+                // Separable [ 1 2 1 ] taps centred on the even source pixel
+                auto const *TP_RESTRICT a = rowOf( std::max( y0 - 1, 0 ) );
+                auto const *TP_RESTRICT b = rowOf( y0 );
+                auto const *TP_RESTRICT d = rowOf( y1 );
+                for ( auto i = 0; i < x.width; ++i )
+                  {
+                    auto const l = std::max( i * 2 - 1, 0 ) * bytes;
+                    auto const m = i * 2 * bytes;
+                    auto const rr = std::min( i * 2 + 1, width - 1 ) * bytes;
+                    for ( auto c = 0; c < bytes; ++c )
+                      {
+                        auto const top = a[ l + c ] + a[ m + c ] * 2 + a[ rr + c ];
+                        auto const middle = b[ l + c ] + b[ m + c ] * 2 + b[ rr + c ];
+                        auto const bottom = d[ l + c ] + d[ m + c ] * 2 + d[ rr + c ];
+                        out[ i * bytes + c ] = static_cast< UInt8 >( ( top + middle * 2 + bottom + 8 ) >> 4 );
+                      }
+                  }
+              }
+          }
+      }
+
+    constexpr static Int kRingRows = 4;
+
+    Offscreen source_{};
+    BlockGrid grid_{};
+    BlockPlanes plane_{};
+    PyramidFilters filter_{};
+    Int pixelBytes_{};
+    std::vector< Level > levels_{};
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_imagepyramid_hh_
@@ -0,0 +1,174 @@
+/// \file imageview.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_imageview_hh_
+#define cspsdkxx_triglavpluginsdk_imageview_hh_
+
+#if !defined( TP_RESTRICT )
+# define TP_RESTRICT __restrict
+#endif // !defined( TP_RESTRICT )
+
+#include <type_traits>
+#include <utility>
+
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+enum class EdgePolicies : UInt8
+  {
+    Clamp,
+    Mirror,
+    Transparent,
+  };
+
+constexpr auto mapEdge( EdgePolicies policy, Int x, Int begin, Int end ) noexcept -> Int
+  {
+    if ( policy == EdgePolicies::Mirror )
+      {
+        auto const n = end - begin;
+        auto i = ( x - begin ) % ( n * 2 );
+        if ( i < 0 )
+          { i += n * 2; }
+        return begin + ( i < n ? i : n * 2 - 1 - i );
+      }
+    return x < begin ? begin : end <= x ? end - 1 : x;
+  }
+
+
+template < class T, Int PixelBytes = 0 >
+class ImageView
+  {
+  public:
+    template < class Y, Int P > friend class ImageView;
+
+    using Value = T;
+    using Address = std::conditional_t< std::is_const< T >::value, Byte const *, Byte * >;
+
+    constexpr static Int kPixelBytes = PixelBytes;
+
+    ~ImageView() = default;
+    constexpr ImageView() noexcept
+      : address_{}, rowBytes_{}, pixelBytes_{ PixelBytes }, width_{}, height_{} {}
+    ImageView( ImageView const & ) = default;
+    ImageView( ImageView && ) = default;
+    auto operator =( ImageView const & ) -> ImageView & = default;
+    auto operator =( ImageView && ) -> ImageView & = default;
+
+    constexpr ImageView( Address address, Int rowBytes, Int pixelBytes, Int width, Int height ) noexcept
+      : address_{ address }, rowBytes_{ rowBytes }, pixelBytes_{ pixelBytes }, width_{ width }, height_{ height }
+      { TP_ASSERT( !PixelBytes || pixelBytes == PixelBytes ); }
+
+    template < class Y, Int P, class = std::enable_if_t< std::is_convertible< Y *, T * >::value > >
+    constexpr ImageView( ImageView< Y, P > const &x ) noexcept
+      : ImageView{ x.address_, x.rowBytes_, x.pixelBytes_, x.width_, x.height_ } {}
+
+    constexpr explicit operator bool() const noexcept
+      { return address_ && width_ > 0 && height_ > 0; }
+
+    constexpr auto address() const noexcept -> Address { return address_; }
+    constexpr auto rowBytes() const noexcept -> Int { return rowBytes_; }
+    constexpr auto pixelBytes() const noexcept -> Int { return PixelBytes ? PixelBytes : pixelBytes_; }
+    constexpr auto pixelStride() const noexcept -> Int { return pixelBytes() / static_cast< Int >( sizeof( T ) ); }
+    constexpr auto width() const noexcept -> Int { return width_; }
+    constexpr auto height() const noexcept -> Int { return height_; }
+
+    auto row( Int y ) const noexcept -> T *
+      { return reinterpret_cast< T * >( address_ + rowBytes_ * y ); }
+
+    auto pixel( Int x, Int y ) const noexcept -> T *
+      { return reinterpret_cast< T * >( address_ + rowBytes_ * y + pixelBytes() * x ); }
+
+    auto operator ()( Int x, Int y ) const noexcept -> T &
+      { return *pixel( x, y ); }
+
+    auto sub( Int x, Int y, Int width, Int height ) const noexcept -> ImageView
+      {
+        TP_ASSERT( 0 <= x && 0 <= y && x + width <= width_ && y + height <= height_ );
+        return ImageView{ address_ + rowBytes_ * y + pixelBytes() * x, rowBytes_, pixelBytes(), width, height };
+      }
+
+    auto channel( Int index ) const noexcept -> ImageView
+      {
+        TP_ASSERT( 0 <= index && ( !pixelBytes() || static_cast< Int >( sizeof( T ) ) * index < pixelBytes() ) );
+        return ImageView{ address_ + sizeof( T ) * index, rowBytes_, pixelBytes(), width_, height_ };
+      }
+
+  private:
+    Address address_;
+    Int rowBytes_;
+    Int pixelBytes_;
+    Int width_;
+    Int height_;
+  };
+
+template < class T, Int PixelBytes = 0 >
+using ConstImageView = ImageView< std::add_const_t< T >, PixelBytes >;
+
+
+template < class T, Int PixelBytes = 0 >
+inline auto makeImageView( Offscreen::MutableBlock const &block, Rect const &rect ) noexcept -> ImageView< T, PixelBytes >
+  { return ImageView< T, PixelBytes >{ block.address, block.rowBytes, block.pixelBytes, rect.right - rect.left, rect.bottom - rect.top }; }
+
+template < class T, Int PixelBytes = 0 >
+inline auto makeImageView( Offscreen::Block const &block, Rect const &rect ) noexcept -> ConstImageView< T, PixelBytes >
+  { return ConstImageView< T, PixelBytes >{ block.address, block.rowBytes, block.pixelBytes, rect.right - rect.left, rect.bottom - rect.top }; }
+
+template < class T, Int PixelBytes = 0 >
+inline auto makeImageView( Bitmap const &bitmap ) noexcept -> APIResult< ImageView< T, PixelBytes > >
+  {
+    auto const width = bitmap.getWidth();
+    auto const height = bitmap.getHeight();
+    auto const rowBytes = bitmap.getRowBytes();
+    auto const pixelBytes = bitmap.getPixelBytes();
+    auto const scanline = bitmap.getScanline();
+    auto const address = bitmap.getMutableAddress( Point{ 0, 0 } );
+    if ( !width || !height || !rowBytes || !pixelBytes || !scanline || !address )
+      { return APIResults::Failed; }
+
+    auto xBytes = *pixelBytes;
+    auto yBytes = *rowBytes;
+    switch ( *scanline )
+      {
+        case Bitmap::Scanlines::HorizontalLeftTop:
+          break;
+        case Bitmap::Scanlines::HorizontalRightTop:
+          xBytes = -xBytes;
+          break;
+        case Bitmap::Scanlines::HorizontalLeftBottom:
+          yBytes = -yBytes;
+          break;
+        case Bitmap::Scanlines::HorizontalRightBottom:
+          xBytes = -xBytes;
+          yBytes = -yBytes;
+          break;
+        case Bitmap::Scanlines::VerticalLeftTop:
+          std::swap( xBytes, yBytes );
+          break;
+        case Bitmap::Scanlines::VerticalRightTop:
+          std::swap( xBytes, yBytes );
+          xBytes = -xBytes;
+          break;
+        case Bitmap::Scanlines::VerticalLeftBottom:
+          std::swap( xBytes, yBytes );
+          yBytes = -yBytes;
+          break;
+        case Bitmap::Scanlines::VerticalRightBottom:
+          std::swap( xBytes, yBytes );
+          xBytes = -xBytes;
+          yBytes = -yBytes;
+          break;
+      }
+
+    if ( PixelBytes && xBytes != PixelBytes )
+      { return APIResults::Failed; }
+    return ImageView< T, PixelBytes >{ *address, yBytes, xBytes, *width, *height };
+  }
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_imageview_hh_
@@ -0,0 +1,270 @@
+/// \file pixeltransfer.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_pixeltransfer_hh_
+#define cspsdkxx_triglavpluginsdk_pixeltransfer_hh_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/ScratchPool.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+enum class TransferPaths : UInt8
+  {
+    Auto,
+    Blocks,
+    Bitmap,
+  };
+
+enum class AccessPatterns : UInt8
+  {
+    Pointwise,
+    Neighborhood,
+    RandomAccess,
+  };
+
+struct TransferOptions
+  {
+    TransferPaths path = TransferPaths::Auto;
+    AccessPatterns pattern = AccessPatterns::Pointwise;
+    std::size_t bitmapBudgetBytes = 16 * 1024 * 1024;
+    std::size_t minBlockPixels = 1024;
+    ScratchPool *pool = nullptr; // keeps the band bitmap across runs when set
+  };
+
+struct TransferBenchmark
+  {
+    double blocksSeconds;
+    double bitmapSeconds;
+    TransferPaths faster;
+  };
+
+
+inline auto chooseTransferPath( BlockGrid const &grid, Int pixelBytes, TransferOptions const &options ) noexcept -> TransferPaths
+  {
+    if ( options.path != TransferPaths::Auto )
+      { return options.path; }
+    if ( !grid )
+      { return TransferPaths::Blocks; }
+
+    auto const &rect = grid.bounds();
+    auto const pixels = static_cast< std::size_t >( rect.right - rect.left ) * static_cast< std::size_t >( rect.bottom - rect.top );
+    auto const bytes = pixels * static_cast< std::size_t >( pixelBytes );
+
+    switch ( options.pattern )
+      {
+        case AccessPatterns::Pointwise:
+          // Zero-copy blocks win unless the region is cut into many tiny clipped blocks
+          return pixels / static_cast< std::size_t >( grid.count() ) < options.minBlockPixels ? TransferPaths::Bitmap : TransferPaths::Blocks;
+        case AccessPatterns::Neighborhood:
+          // A kernel that reads neighbours must see the whole region at once; PixelTransfer::make refuses it otherwise
+          return TransferPaths::Bitmap;
+        case AccessPatterns::RandomAccess:
+          // Contiguous rows pay off when one bitmap can hold the whole region
+          return bytes <= options.bitmapBudgetBytes ? TransferPaths::Bitmap : TransferPaths::Blocks;
+      }
+    return TransferPaths::Blocks;
+  }
+
+
+class PixelTransfer
+  {
+  public:
+    ~PixelTransfer() = default;
+    PixelTransfer() = default;
+    PixelTransfer( PixelTransfer const & ) = delete;
+    PixelTransfer( PixelTransfer && ) = default;
+    auto operator =( PixelTransfer const & ) -> PixelTransfer & = delete;
+    auto operator =( PixelTransfer && ) -> PixelTransfer & = default;
+
+    // plane None addresses the single plane of an offscreen made by makePlaneOffscreen
+    auto make( std::weak_ptr< Server const > const &server, Offscreen const &offscreen, BlockPlanes plane, Rect const &bounds, TransferOptions const &options = TransferOptions{} ) -> APIResult< void >
+      {
+        TP_ASSERT( plane == BlockPlanes::Image || plane == BlockPlanes::Alpha || plane == BlockPlanes::None );
+
+        BlockGrid grid{};
+        if ( !grid.make( offscreen, bounds ) || !grid )
+          { return APIResults::Failed; }
+
+        offscreen_ = offscreen;
+        grid_ = grid;
+        plane_ = plane;
+
+        auto const rect = grid_.rect( 0 );
+        auto const block = fetchBlock( Point{ rect.left, rect.top } );
+        if ( !block )
+          { return APIResults::Failed; }
+        pixelBytes_ = block->pixelBytes;
+
+        path_ = chooseTransferPath( grid_, pixelBytes_, options );
+        if ( path_ == TransferPaths::Bitmap )
+          {
+            auto const &r = grid_.bounds();
+            auto const rowBytes = static_cast< std::size_t >( ( r.right - r.left ) * pixelBytes_ );
+            bandHeight_ = static_cast< Int >( std::max< std::size_t >( 1, std::min< std::size_t >( options.bitmapBudgetBytes / rowBytes, static_cast< std::size_t >( r.bottom - r.top ) ) ) );
+            auto const width = r.right - r.left;
+            auto const scanline = Bitmap::Scanlines::HorizontalLeftTop;
+            if ( options.pool )
+              { bitmap_ = options.pool->acquireBitmap( server, width, bandHeight_, pixelBytes_, scanline ); }
+            else
+              { bitmap_ = ScratchBitmap{ {}, ScratchKey{ ScratchKey::Kinds::Bitmap, width, bandHeight_, pixelBytes_, scanline }, makeBitmap( server, width, bandHeight_, pixelBytes_, scanline ) }; }
+            if ( !bitmap_ )
+              { return APIResults::Failed; }
+          }
+
+        // Units are isolated without a halo, so seams would depend on the path; larger regions go through HaloFetcher
+        if ( options.pattern == AccessPatterns::Neighborhood && count() != 1 )
+          { return APIResults::Failed; }
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( grid_ ); }
+
+    auto path() const noexcept -> TransferPaths
+      { return path_; }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto count() const noexcept -> Int
+      {
+        if ( path_ != TransferPaths::Bitmap )
+          { return grid_.count(); }
+        auto const &r = grid_.bounds();
+        return ( r.bottom - r.top + bandHeight_ - 1 ) / bandHeight_;
+      }
+
+    auto rect( Int index ) const noexcept -> Rect
+      {
+        if ( path_ != TransferPaths::Bitmap )
+          { return grid_.rect( index ); }
+        auto const &r = grid_.bounds();
+        auto const top = r.top + index * bandHeight_;
+        return Rect{ r.left, top, r.right, std::min( top + bandHeight_, r.bottom ) };
+      }
+
+    // Calls kernel( rect, view ) for one unit; bitmap units are copied in before and written back after
+    template < class Kernel >
+    auto apply( Int index, Kernel &&kernel ) -> APIResult< void >
+      {
+        auto const r = rect( index );
+        Point const pos{ r.left, r.top };
+        if ( path_ != TransferPaths::Bitmap )
+          {
+            auto const block = fetchBlock( pos );
+            if ( !block )
+              { return APIResults::Failed; }
+            kernel( r, makeImageView< UInt8 >( *block, r ) );
+            return APIResults::Success;
+          }
+
+        auto const width = r.right - r.left;
+        auto const height = r.bottom - r.top;
+        auto const mode = copyMode();
+        if ( !offscreen_.getBitmap( *bitmap_, Point{ 0, 0 }, pos, width, height, mode ) )
+          { return APIResults::Failed; }
+        auto const view = makeImageView< UInt8 >( *bitmap_ );
+        if ( !view )
+          { return APIResults::Failed; }
+        kernel( r, view->sub( 0, 0, width, height ) );
+        return offscreen_.setBitmap( pos, *bitmap_, Point{ 0, 0 }, width, height, mode );
+      }
+
+    template < class Kernel >
+    auto applyAll( Kernel &&kernel ) -> APIResult< void >
+      {
+        for ( auto i = 0; i < count(); ++i )
+          {
+            if ( !apply( i, kernel ) )
+              { return APIResults::Failed; }
+          }
+        return APIResults::Success;
+      }
+
+  private:
+    auto fetchBlock( Point const &pos ) const noexcept -> APIResult< Offscreen::MutableBlock >
+      {
+        switch ( plane_ )
+          {
+            case BlockPlanes::Image:
+              return offscreen_.getMutableBlockImage( pos );
+            case BlockPlanes::Alpha:
+              return offscreen_.getMutableBlockAlpha( pos );
+            default:
+              return offscreen_.getMutableBlockPlane( pos );
+          }
+      }
+
+    auto copyMode() const noexcept -> Offscreen::CopyModes
+      {
+        switch ( plane_ )
+          {
+            case BlockPlanes::Image:
+              return Offscreen::CopyModes::Image;
+            case BlockPlanes::Alpha:
+              return Offscreen::CopyModes::Alpha;
+            default:
+              return Offscreen::CopyModes::Normal;
+          }
+      }
+
+    Offscreen offscreen_{};
+    ScratchBitmap bitmap_{};
+    BlockGrid grid_{};
+    BlockPlanes plane_{};
+    TransferPaths path_{ TransferPaths::Blocks };
+    Int pixelBytes_{};
+    Int bandHeight_{ 1 };
+  };
+
+
+// Runs the same kernel over both paths on a scratch plane of width x height at depth bits, so the user's layer is never written
+template < class Kernel >
+inline auto benchmarkPixelTransfer( std::weak_ptr< Server const > const &server, Int width, Int height, Int depth, Kernel &&kernel, Int repetitions = 3 ) -> APIResult< TransferBenchmark >
+  {
+    auto const scratch = makePlaneOffscreen( server, width, height, depth );
+    if ( !scratch )
+      { return APIResults::Failed; }
+
+    auto const measure = [ & ]( TransferPaths path, double &seconds ) -> bool
+      {
+        TransferOptions options{};
+        options.path = path;
+        PixelTransfer transfer{};
+        if ( !transfer.make( server, scratch, BlockPlanes::None, Rect{ 0, 0, width, height }, options ) )
+          { return false; }
+
+        auto best = 0.0;
+        for ( auto i = 0; i < repetitions; ++i )
+          {
+            auto const start = std::chrono::steady_clock::now();
+            if ( !transfer.applyAll( kernel ) )
+              { return false; }
+            auto const elapsed = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+            best = i ? std::min( best, elapsed ) : elapsed;
+          }
+        seconds = best;
+        return true;
+      };
+
+    TransferBenchmark result{};
+    if ( !measure( TransferPaths::Blocks, result.blocksSeconds ) || !measure( TransferPaths::Bitmap, result.bitmapSeconds ) )
+      { return APIResults::Failed; }
+    result.faster = result.bitmapSeconds < result.blocksSeconds ? TransferPaths::Bitmap : TransferPaths::Blocks;
+    return result;
+  }
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_pixeltransfer_hh_
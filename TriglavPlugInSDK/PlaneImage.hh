@@ -0,0 +1,228 @@
+/// \file planeimage.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_planeimage_hh_
+#define cspsdkxx_triglavpluginsdk_planeimage_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+struct BlockCacheStatistics
+  {
+    std::size_t hits;
+    std::size_t misses;
+  };
+
+
+template < class T >
+class PlaneImage
+  {
+    static_assert( sizeof( T ) == 1 || sizeof( T ) == 2, "PlaneImage supports 8-bit or 16-bit planes" );
+
+  public:
+    constexpr static Int kDepth = static_cast< Int >( sizeof( T ) * 8 );
+    constexpr static std::size_t kDefaultCacheSize = 8;
+
+    ~PlaneImage() = default;
+    PlaneImage() = default;
+    PlaneImage( PlaneImage const & ) = delete;
+    PlaneImage( PlaneImage && ) = default;
+    auto operator =( PlaneImage const & ) -> PlaneImage & = delete;
+    auto operator =( PlaneImage && ) -> PlaneImage & = default;
+
+    auto make( std::weak_ptr< Server const > const &server, Int width, Int height, Int channels, std::size_t cacheSize = kDefaultCacheSize ) -> APIResult< void >
+      {
+        std::vector< Offscreen > planes{};
+        planes.reserve( static_cast< std::size_t >( channels ) );
+        for ( auto i = Int{}; i < channels; ++i )
+          {
+            planes.push_back( makePlaneOffscreen( server, width, height, kDepth ) );
+            if ( !planes.back() )
+              { return APIResults::Failed; }
+          }
+        return make( std::move( planes ), cacheSize );
+      }
+
+    auto make( std::vector< Offscreen > planes, std::size_t cacheSize = kDefaultCacheSize ) -> APIResult< void >
+      {
+        if ( planes.empty() || !cacheSize )
+          { return APIResults::Failed; }
+
+        auto const rect = planes.front().getRect();
+        if ( !rect )
+          { return APIResults::Failed; }
+
+        BlockGrid grid{};
+        if ( !grid.make( planes.front(), *rect ) )
+          { return APIResults::Failed; }
+
+        planes_ = std::move( planes );
+        grid_ = grid;
+        cache_.assign( cacheSize, Entry{} );
+        clock_ = 0;
+        statistics_ = BlockCacheStatistics{};
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return !planes_.empty() && static_cast< bool >( grid_ ); }
+
+    auto channels() const noexcept -> Int
+      { return static_cast< Int >( planes_.size() ); }
+
+    auto plane( Int channel ) const noexcept -> Offscreen const &
+      { return planes_[ static_cast< std::size_t >( channel ) ]; }
+
+    auto rect() const noexcept -> Rect const &
+      { return grid_.bounds(); }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto statistics() const noexcept -> BlockCacheStatistics const &
+      { return statistics_; }
+
+    void invalidate() noexcept
+      {
+        std::fill( cache_.begin(), cache_.end(), Entry{} );
+        clock_ = 0;
+      }
+
+    auto block( Int channel, Int index ) noexcept -> ImageView< T >
+      {
+        auto lru = cache_.begin();
+        for ( auto it = cache_.begin(); it != cache_.end(); ++it )
+          {
+            if ( it->stamp && it->channel == channel && it->index == index )
+              {
+                ++statistics_.hits;
+                it->stamp = ++clock_;
+                return it->view;
+              }
+            if ( it->stamp < lru->stamp )
+              { lru = it; }
+          }
+
+        ++statistics_.misses;
+        auto const rect = grid_.rect( index );
+        auto const x = plane( channel ).getMutableBlockPlane( Point{ rect.left, rect.top } );
+        if ( !x )
+          { return ImageView< T >{}; }
+
+        *lru = Entry{ channel, index, ++clock_, makeImageView< T >( *x, rect ) };
+        return lru->view;
+      }
+
+    auto blockAt( Int channel, Point const &pos, Rect *blockRect = nullptr ) noexcept -> ImageView< T >
+      {
+        auto const index = grid_.indexAt( pos );
+        if ( index < 0 )
+          { return ImageView< T >{}; }
+        if ( blockRect )
+          { *blockRect = grid_.rect( index ); }
+        return block( channel, index );
+      }
+
+    auto pixel( Int channel, Point const &pos ) noexcept -> T *
+      {
+        Rect r{};
+        if ( auto const view = blockAt( channel, pos, &r ) )
+          { return view.pixel( pos.x - r.left, pos.y - r.top ); }
+        return nullptr;
+      }
+
+    auto read( Int channel, Rect const &rect, ImageView< T > const &destination ) noexcept -> APIResult< void >
+      {
+        return transfer( channel, rect, [ & ]( ImageView< T > const &block, Int bx, Int by, Int dx, Int dy, Int width, Int height )
+          { copy( block.sub( bx, by, width, height ), destination.sub( dx, dy, width, height ) ); } );
+      }
+
+    auto write( Int channel, Rect const &rect, ConstImageView< T > const &source ) noexcept -> APIResult< void >
+      {
+        return transfer( channel, rect, [ & ]( ImageView< T > const &block, Int bx, Int by, Int sx, Int sy, Int width, Int height )
+          { copy( source.sub( sx, sy, width, height ), block.sub( bx, by, width, height ) ); } );
+      }
+
+  private:
+    struct Entry
+      {
+        Int channel;
+        Int index;
+        std::size_t stamp;
+        ImageView< T > view;
+      };
+
+    template < class F >
+    auto transfer( Int channel, Rect const &rect, F &&f ) noexcept -> APIResult< void >
+      {
+        if ( isEmpty( rect ) )
+          { return APIResults::Success; }
+
+        auto const &bounds = grid_.bounds();
+        if ( rect.left < bounds.left || rect.top < bounds.top || bounds.right < rect.right || bounds.bottom < rect.bottom )
+          { return APIResults::Failed; }
+
+        for ( auto y = rect.top; y < rect.bottom; )
+          {
+            // Every block of a grid row shares its bottom, so the last visited block decides the next row
+            auto bottom = rect.bottom;
+            for ( auto x = rect.left; x < rect.right; )
+              {
+                Rect r{};
+                auto const view = blockAt( channel, Point{ x, y }, &r );
+                if ( !view )
+                  { return APIResults::Failed; }
+                auto const right = std::min( r.right, rect.right );
+                bottom = std::min( r.bottom, rect.bottom );
+                f( view, x - r.left, y - r.top, x - rect.left, y - rect.top, right - x, bottom - y );
+                x = right;
+              }
+            y = bottom;
+          }
+        return APIResults::Success;
+      }
+
+    template < class Source, class Destination >
+    static void copy( Source const &source, Destination const &destination ) noexcept
+      {
+        auto const bytes = static_cast< std::size_t >( source.width() ) * sizeof( T );
+        auto const packed = source.pixelBytes() == static_cast< Int >( sizeof( T ) ) && destination.pixelBytes() == static_cast< Int >( sizeof( T ) );
+        for ( auto y = 0; y < source.height(); ++y )
+          {
+            auto const *TP_RESTRICT s = source.row( y );
+            auto *TP_RESTRICT d = destination.row( y );
+            if ( packed )
+              { std::memcpy( d, s, bytes ); }
+            else
+              {
+                for ( auto x = 0; x < source.width(); ++x )
+                  { d[ x * destination.pixelStride() ] = s[ x * source.pixelStride() ]; }
+              }
+          }
+      }
+
+    std::vector< Offscreen > planes_{};
+    BlockGrid grid_{};
+    std::vector< Entry > cache_{};
+    std::size_t clock_{};
+    BlockCacheStatistics statistics_{};
+  };
+
+using PlaneImage8 = PlaneImage< UInt8 >;
+using PlaneImage16 = PlaneImage< UInt16 >;
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_planeimage_hh_
@@ -0,0 +1,248 @@
+/// \file sampler.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_sampler_hh_
+#define cspsdkxx_triglavpluginsdk_sampler_hh_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+enum class Interpolations : UInt8
+  {
+    Nearest,
+    Bilinear,
+    Bicubic,
+  };
+
+
+class OffscreenSampler
+  {
+  public:
+    constexpr static Int kDefaultCacheSize = 64;
+
+    ~OffscreenSampler() = default;
+    OffscreenSampler() = default;
+    OffscreenSampler( OffscreenSampler const & ) = delete;
+    OffscreenSampler( OffscreenSampler && ) = default;
+    auto operator =( OffscreenSampler const & ) -> OffscreenSampler & = delete;
+    auto operator =( OffscreenSampler && ) -> OffscreenSampler & = default;
+
+    auto make( Offscreen const &offscreen, BlockPlanes plane, EdgePolicies policy, Int cacheSize = kDefaultCacheSize ) -> APIResult< void >
+      {
+        TP_ASSERT( plane == BlockPlanes::Image || plane == BlockPlanes::Alpha || plane == BlockPlanes::SelectArea );
+        TP_ASSERT( cacheSize > 0 && !( cacheSize & ( cacheSize - 1 ) ) );
+
+        auto const rect = offscreen.getRect();
+        if ( !rect )
+          { return APIResults::Failed; }
+
+        BlockGrid grid{};
+        if ( !grid.make( offscreen, *rect ) || !grid )
+          { return APIResults::Failed; }
+
+        offscreen_ = offscreen;
+        grid_ = grid;
+        plane_ = plane;
+        policy_ = policy;
+        cache_.assign( static_cast< std::size_t >( cacheSize ), Entry{} );
+        mask_ = cacheSize - 1;
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( grid_ ); }
+
+    auto rect() const noexcept -> Rect const &
+      { return grid_.bounds(); }
+
+    void invalidate() noexcept
+      { std::fill( cache_.begin(), cache_.end(), Entry{} ); }
+
+    // Returns the pixel at ( x, y ) after applying the edge policy; Transparent edges read as zero
+    auto pixel( Int x, Int y ) noexcept -> UInt8 const *
+      {
+        static UInt8 const zero[ 8 ]{};
+
+        auto const &bounds = grid_.bounds();
+        if ( x < bounds.left || bounds.right <= x || y < bounds.top || bounds.bottom <= y )
+          {
+            if ( policy_ == EdgePolicies::Transparent )
+              { return zero; }
+            x = mapEdge( policy_, x, bounds.left, bounds.right );
+            y = mapEdge( policy_, y, bounds.top, bounds.bottom );
+          }
+
+        auto const &entry = resolve( grid_.indexAt( Point{ x, y } ) );
+        if ( !entry.address )
+          { return zero; }
+        return reinterpret_cast< UInt8 const * >( entry.address + entry.rowBytes * ( y - entry.rect.top ) + entry.pixelBytes * ( x - entry.rect.left ) );
+      }
+
+    auto nearest( Float x, Float y, Int channel ) noexcept -> Float
+      { return pixel( static_cast< Int >( std::floor( x ) ), static_cast< Int >( std::floor( y ) ) )[ channel ]; }
+
+    auto bilinear( Float x, Float y, Int channel ) noexcept -> Float
+      {
+        x -= Float( 0.5 );
+        y -= Float( 0.5 );
+        auto const fx = std::floor( x );
+        auto const fy = std::floor( y );
+        auto const ix = static_cast< Int >( fx );
+        auto const iy = static_cast< Int >( fy );
+        auto const tx = x - fx;
+        auto const ty = y - fy;
+
+        Float const p00 = pixel( ix, iy )[ channel ];
+        Float const p10 = pixel( ix + 1, iy )[ channel ];
+        Float const p01 = pixel( ix, iy + 1 )[ channel ];
+        Float const p11 = pixel( ix + 1, iy + 1 )[ channel ];
+        auto const a = p00 + ( p10 - p00 ) * tx;
+        auto const b = p01 + ( p11 - p01 ) * tx;
+        return a + ( b - a ) * ty;
+      }
+
+    auto bicubic( Float x, Float y, Int channel ) noexcept -> Float
+      {
+        x -= Float( 0.5 );
+        y -= Float( 0.5 );
+        auto const fx = std::floor( x );
+        auto const fy = std::floor( y );
+        auto const ix = static_cast< Int >( fx );
+        auto const iy = static_cast< Int >( fy );
+
+        Float wx[ 4 ]{};
+        Float wy[ 4 ]{};
+        catmullRom( x - fx, wx );
+        catmullRom( y - fy, wy );
+
+        Float result{};
+        for ( auto j = 0; j < 4; ++j )
+          {
+            Float row{};
+            for ( auto i = 0; i < 4; ++i )
+              { row += wx[ i ] * pixel( ix - 1 + i, iy - 1 + j )[ channel ]; }
+            result += wy[ j ] * row;
+          }
+        return result < 0 ? Float( 0 ) : Float( 255 ) < result ? Float( 255 ) : result;
+      }
+
+    auto sample( Float x, Float y, Int channel, Interpolations interpolation ) noexcept -> Float
+      {
+        switch ( interpolation )
+          {
+            case Interpolations::Nearest:
+              return nearest( x, y, channel );
+            case Interpolations::Bilinear:
+              return bilinear( x, y, channel );
+            case Interpolations::Bicubic:
+              return bicubic( x, y, channel );
+          }
+        return Float{};
+      }
+
+    template < Interpolations Interpolation >
+    void gather( Float const *xs, Float const *ys, Int count, Int channel, Float *result ) noexcept
+      {
+        for ( auto i = 0; i < count; ++i )
+          {
+            switch ( Interpolation )
+              {
+                case Interpolations::Nearest:
+                  result[ i ] = nearest( xs[ i ], ys[ i ], channel );
+                  break;
+                case Interpolations::Bilinear:
+                  result[ i ] = bilinear( xs[ i ], ys[ i ], channel );
+                  break;
+                case Interpolations::Bicubic:
+                  result[ i ] = bicubic( xs[ i ], ys[ i ], channel );
+                  break;
+              }
+          }
+      }
+
+    void gather( Float const *xs, Float const *ys, Int count, Int channel, Interpolations interpolation, Float *result ) noexcept
+      {
+        switch ( interpolation )
+          {
+            case Interpolations::Nearest:
+              gather< Interpolations::Nearest >( xs, ys, count, channel, result );
+              break;
+            case Interpolations::Bilinear:
+              gather< Interpolations::Bilinear >( xs, ys, count, channel, result );
+              break;
+            case Interpolations::Bicubic:
+              gather< Interpolations::Bicubic >( xs, ys, count, channel, result );
+              break;
+          }
+      }
+
+  private:
+    struct Entry
+      {
+        Int index = -1;
+        Byte const *address = nullptr;
+        Int rowBytes = 0;
+        Int pixelBytes = 0;
+        Rect rect{};
+      };
+
+    auto resolve( Int index ) noexcept -> Entry const &
+      {
+        auto &entry = cache_[ static_cast< std::size_t >( index & mask_ ) ];
+        if ( entry.index == index )
+          { return entry; }
+
+        auto const rect = grid_.rect( index );
+        Point const pos{ rect.left, rect.top };
+        APIResult< Offscreen::Block > block{};
+        switch ( plane_ )
+          {
+            case BlockPlanes::Image:
+              block = offscreen_.getBlockImage( pos );
+              break;
+            case BlockPlanes::Alpha:
+              block = offscreen_.getBlockAlpha( pos );
+              break;
+            default:
+              block = offscreen_.getBlockSelectArea( pos );
+              break;
+          }
+
+        entry = Entry{};
+        if ( block )
+          { entry = Entry{ index, block->address, block->rowBytes, block->pixelBytes, rect }; }
+        return entry;
+      }
+
+    static void catmullRom( Float t, Float *w ) noexcept
+      {
+        auto const t2 = t * t;
+        auto const t3 = t2 * t;
+        w[ 0 ] = Float( 0.5 ) * ( -t3 + Float( 2 ) * t2 - t );
+        w[ 1 ] = Float( 0.5 ) * ( Float( 3 ) * t3 - Float( 5 ) * t2 + Float( 2 ) );
+        w[ 2 ] = Float( 0.5 ) * ( Float( -3 ) * t3 + Float( 4 ) * t2 + t );
+        w[ 3 ] = Float( 0.5 ) * ( t3 - t2 );
+      }
+
+    Offscreen offscreen_{};
+    BlockGrid grid_{};
+    BlockPlanes plane_{};
+    EdgePolicies policy_{};
+    std::vector< Entry > cache_{};
+    Int mask_{};
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_sampler_hh_
@@ -0,0 +1,256 @@
+/// \file scratchpool.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_scratchpool_hh_
+#define cspsdkxx_triglavpluginsdk_scratchpool_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <list>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+struct ScratchKey
+  {
+    enum class Kinds : UInt8
+      {
+        Bitmap,
+        PlaneOffscreen,
+      };
+
+    Kinds kind;
+    Int width;
+    Int height;
+    Int depth;
+    Bitmap::Scanlines scanline;
+
+    // Bitmap depth counts channels of one byte; plane offscreen depth counts bits
+    constexpr auto pixelBytes() const noexcept -> std::size_t
+      { return static_cast< std::size_t >( kind == Kinds::PlaneOffscreen ? ( depth + 7 ) / 8 : depth ); }
+
+    constexpr auto bytes() const noexcept -> std::size_t
+      { return static_cast< std::size_t >( width ) * static_cast< std::size_t >( height ) * pixelBytes(); }
+
+    friend auto operator ==( ScratchKey const &a, ScratchKey const &b ) noexcept -> bool
+      { return std::tie( a.kind, a.width, a.height, a.depth, a.scanline ) == std::tie( b.kind, b.width, b.height, b.depth, b.scanline ); }
+
+    friend auto operator !=( ScratchKey const &a, ScratchKey const &b ) noexcept -> bool
+      { return !( a == b ); }
+  };
+
+struct ScratchPoolStatistics
+  {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+    std::size_t pooledObjects;
+    std::size_t pooledBytes;
+    std::size_t peakPooledBytes;
+  };
+
+
+class ScratchPool;
+
+// A lease only refers to its pool weakly; once the pool is gone the object is released instead of recycled
+template < class T >
+class ScratchLease
+  {
+  public:
+    ~ScratchLease() { recycle(); }
+    ScratchLease() noexcept : pool_{}, key_{}, object_{} {}
+    ScratchLease( ScratchLease const & ) = delete;
+    ScratchLease( ScratchLease &&x ) noexcept
+      : pool_{ std::move( x.pool_ ) }, key_{ x.key_ }, object_{ std::move( x.object_ ) }
+      { x.pool_.reset(); }
+    auto operator =( ScratchLease const & ) -> ScratchLease & = delete;
+    auto operator =( ScratchLease &&x ) noexcept -> ScratchLease &
+      {
+        if ( this != &x )
+          {
+            recycle();
+            pool_ = std::move( x.pool_ );
+            key_ = x.key_;
+            object_ = std::move( x.object_ );
+            x.pool_.reset();
+          }
+        return *this;
+      }
+
+    ScratchLease( std::weak_ptr< ScratchPool * > pool, ScratchKey const &key, T object ) noexcept
+      : pool_{ std::move( pool ) }, key_{ key }, object_{ std::move( object ) } {}
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( object_ ); }
+
+    auto operator *() const noexcept -> T const & { return object_; }
+    auto operator->() const noexcept -> T const * { return &object_; }
+
+    auto get() const noexcept -> T const & { return object_; }
+    auto key() const noexcept -> ScratchKey const & { return key_; }
+
+  private:
+    inline void recycle() noexcept;
+
+    std::weak_ptr< ScratchPool * > pool_;
+    ScratchKey key_;
+    T object_;
+  };
+
+using ScratchBitmap = ScratchLease< Bitmap >;
+using ScratchPlaneOffscreen = ScratchLease< Offscreen >;
+
+
+class ScratchPool
+  {
+  public:
+    template < class T > friend class ScratchLease;
+
+    ~ScratchPool()
+      {
+        self_.reset();
+        clear();
+      }
+    ScratchPool() : ScratchPool{ std::numeric_limits< std::size_t >::max() } {}
+    ScratchPool( ScratchPool const & ) = delete;
+    ScratchPool( ScratchPool && ) = delete;
+    auto operator =( ScratchPool const & ) -> ScratchPool & = delete;
+    auto operator =( ScratchPool && ) -> ScratchPool & = delete;
+
+    explicit ScratchPool( std::size_t capacityBytes )
+      : self_{ std::make_shared< ScratchPool * >( this ) }, capacityBytes_{ capacityBytes }, entries_{}, statistics_{} {}
+
+    auto acquireBitmap( std::weak_ptr< Server const > const &server, Int width, Int height, Int depth, Bitmap::Scanlines scanline ) -> ScratchBitmap
+      {
+        ScratchKey const key{ ScratchKey::Kinds::Bitmap, width, height, depth, scanline };
+        Bitmap x{};
+        if ( take( key, &Entry::bitmap, x ) )
+          {
+            x.rebind( server );
+            return ScratchBitmap{ self_, key, std::move( x ) };
+          }
+        return ScratchBitmap{ self_, key, makeBitmap( server, width, height, depth, scanline ) };
+      }
+
+    auto acquirePlaneOffscreen( std::weak_ptr< Server const > const &server, Int width, Int height, Int depth ) -> ScratchPlaneOffscreen
+      {
+        ScratchKey const key{ ScratchKey::Kinds::PlaneOffscreen, width, height, depth, Bitmap::Scanlines::HorizontalLeftTop };
+        Offscreen x{};
+        if ( take( key, &Entry::offscreen, x ) )
+          {
+            x.rebind( server );
+            return ScratchPlaneOffscreen{ self_, key, std::move( x ) };
+          }
+        return ScratchPlaneOffscreen{ self_, key, makePlaneOffscreen( server, width, height, depth ) };
+      }
+
+    auto capacityBytes() const noexcept -> std::size_t
+      { return capacityBytes_; }
+
+    void setCapacityBytes( std::size_t x ) noexcept
+      {
+        capacityBytes_ = x;
+        trim( 0 );
+      }
+
+    auto statistics() const noexcept -> ScratchPoolStatistics const &
+      { return statistics_; }
+
+    void clear() noexcept
+      {
+        MemoryAccounting::instance().deallocate( MemoryCategories::Pools, statistics_.pooledBytes );
+        entries_.clear();
+        statistics_.pooledObjects = 0;
+        statistics_.pooledBytes = 0;
+      }
+
+  private:
+    struct Entry
+      {
+        ScratchKey key;
+        Bitmap bitmap;
+        Offscreen offscreen;
+      };
+
+    template < class T >
+    auto take( ScratchKey const &key, T Entry::*member, T &x ) noexcept -> bool
+      {
+        for ( auto it = entries_.begin(); it != entries_.end(); ++it )
+          {
+            if ( it->key == key )
+              {
+                x = std::move( ( *it ).*member );
+                entries_.erase( it );
+                --statistics_.pooledObjects;
+                statistics_.pooledBytes -= key.bytes();
+                MemoryAccounting::instance().deallocate( MemoryCategories::Pools, key.bytes() );
+                ++statistics_.hits;
+                return true;
+              }
+          }
+        ++statistics_.misses;
+        return false;
+      }
+
+    void trim( std::size_t reserveBytes ) noexcept
+      {
+        while ( !entries_.empty() && ( statistics_.pooledBytes > capacityBytes_ || capacityBytes_ - statistics_.pooledBytes < reserveBytes ) )
+          {
+            statistics_.pooledBytes -= entries_.back().key.bytes();
+            MemoryAccounting::instance().deallocate( MemoryCategories::Pools, entries_.back().key.bytes() );
+            --statistics_.pooledObjects;
+            ++statistics_.evictions;
+            entries_.pop_back();
+          }
+      }
+
+    void recycle( ScratchKey const &key, Entry &&entry ) noexcept
+      {
+        if ( key.bytes() > capacityBytes_ )
+          {
+            ++statistics_.evictions;
+            return;
+          }
+
+        trim( key.bytes() );
+        entries_.push_front( std::move( entry ) );
+        ++statistics_.pooledObjects;
+        statistics_.pooledBytes += key.bytes();
+        MemoryAccounting::instance().allocate( MemoryCategories::Pools, key.bytes() );
+        statistics_.peakPooledBytes = std::max( statistics_.peakPooledBytes, statistics_.pooledBytes );
+      }
+
+    void recycle( ScratchKey const &key, Bitmap &&x ) noexcept
+      { recycle( key, Entry{ key, std::move( x ), Offscreen{} } ); }
+
+    void recycle( ScratchKey const &key, Offscreen &&x ) noexcept
+      { recycle( key, Entry{ key, Bitmap{}, std::move( x ) } ); }
+
+    std::shared_ptr< ScratchPool * > self_;
+    std::size_t capacityBytes_;
+    std::list< Entry > entries_;
+    ScratchPoolStatistics statistics_;
+  };
+
+
+template < class T >
+inline void ScratchLease< T >::recycle() noexcept
+  {
+    auto const pool = pool_.lock();
+    if ( pool && object_.object() )
+      { ( *pool )->recycle( key_, std::move( object_ ) ); }
+    pool_.reset();
+  }
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_scratchpool_hh_
@@ -0,0 +1,189 @@
+/// \file selectioncoverage.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_selectioncoverage_hh_
+#define cspsdkxx_triglavpluginsdk_selectioncoverage_hh_
+
+#include <cstddef>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+enum class Coverages : UInt8
+  {
+    Empty,
+    Full,
+    Partial,
+  };
+
+struct CoverageSpan
+  {
+    Int left;
+    Int right;
+    Coverages coverage;
+    std::size_t value; // first select value of a Partial span, see SelectionCoverage::values
+  };
+
+struct CoverageRow
+  {
+    CoverageSpan const *first;
+    CoverageSpan const *last;
+
+    auto begin() const noexcept -> CoverageSpan const *
+      { return first; }
+
+    auto end() const noexcept -> CoverageSpan const *
+      { return last; }
+  };
+
+struct SelectionCoverageStatistics
+  {
+    Int emptyBlocks;
+    Int fullBlocks;
+    Int partialBlocks;
+  };
+
+
+class SelectionCoverage
+  {
+  public:
+    ~SelectionCoverage() = default;
+    SelectionCoverage() = default;
+    SelectionCoverage( SelectionCoverage const & ) = delete;
+    SelectionCoverage( SelectionCoverage && ) = default;
+    auto operator =( SelectionCoverage const & ) -> SelectionCoverage & = delete;
+    auto operator =( SelectionCoverage && ) -> SelectionCoverage & = default;
+
+    // Scans the select area once per run; without a select area every block is Full.
+    // Partial spans keep their select values so the kernel never fetches the select area again
+    auto make( Offscreen const &selectAreaOffscreen, BlockGrid const &grid ) -> APIResult< void >
+      {
+        grid_ = grid;
+        blocks_.assign( static_cast< std::size_t >( grid_.count() ), Coverages::Full );
+        rowOffsets_.assign( static_cast< std::size_t >( grid_.count() ), 0 );
+        rows_.clear();
+        spans_.clear();
+        values_.clear();
+        statistics_ = SelectionCoverageStatistics{ 0, grid_.count(), 0 };
+
+        if ( !selectAreaOffscreen )
+          { return APIResults::Success; }
+
+        statistics_.fullBlocks = 0;
+        for ( auto i = 0; i < grid_.count(); ++i )
+          {
+            auto const rect = grid_.rect( i );
+            auto const block = selectAreaOffscreen.getBlockSelectArea( Point{ rect.left, rect.top } );
+            if ( !block )
+              { return APIResults::Failed; }
+            scan( i, makeImageView< UInt8 const >( *block, rect ) );
+          }
+        return APIResults::Success;
+      }
+
+    void release() noexcept
+      { *this = SelectionCoverage{}; }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto block( Int index ) const noexcept -> Coverages
+      { return blocks_[ static_cast< std::size_t >( index ) ]; }
+
+    // Spans of row y ( relative to the block ) with x relative to the block; only valid for Partial blocks
+    auto row( Int index, Int y ) const noexcept -> CoverageRow
+      {
+        TP_ASSERT( block( index ) == Coverages::Partial );
+        auto const offset = rowOffsets_[ static_cast< std::size_t >( index ) ] + static_cast< std::size_t >( y );
+        return CoverageRow{ spans_.data() + rows_[ offset ], spans_.data() + rows_[ offset + 1 ] };
+      }
+
+    // Select values of a Partial span, one byte per pixel starting at span.left
+    auto values( CoverageSpan const &span ) const noexcept -> UInt8 const *
+      {
+        TP_ASSERT( span.coverage == Coverages::Partial );
+        return values_.data() + span.value;
+      }
+
+    // Blocks that hold no selection and can be skipped without fetching any plane
+    auto emptyBlocks() const -> std::vector< bool >
+      {
+        std::vector< bool > result( blocks_.size() );
+        for ( std::size_t i = 0; i < blocks_.size(); ++i )
+          { result[ i ] = blocks_[ i ] == Coverages::Empty; }
+        return result;
+      }
+
+    auto statistics() const noexcept -> SelectionCoverageStatistics const &
+      { return statistics_; }
+
+  private:
+    static auto classify( UInt8 x ) noexcept -> Coverages
+      { return x == 0x00 ? Coverages::Empty : x == 0xFF ? Coverages::Full : Coverages::Partial; }
+
+    void scan( Int index, ConstImageView< UInt8 > const &view )
+      {
+        auto const stride = view.pixelStride();
+        auto const first = spans_.size();
+        auto const firstRow = rows_.size();
+        auto const firstValue = values_.size();
+        auto any = false;
+        auto all = true;
+
+        for ( auto y = 0; y < view.height(); ++y )
+          {
+            rows_.push_back( spans_.size() );
+            auto const *p = view.row( y );
+            for ( auto x = 0; x < view.width(); )
+              {
+                auto const coverage = classify( p[ x * stride ] );
+                auto const left = x;
+                for ( ++x; x < view.width() && classify( p[ x * stride ] ) == coverage; ++x )
+                  {}
+                spans_.push_back( CoverageSpan{ left, x, coverage, values_.size() } );
+                if ( coverage == Coverages::Partial )
+                  {
+                    for ( auto i = left; i < x; ++i )
+                      { values_.push_back( p[ i * stride ] ); }
+                  }
+                any = any || coverage != Coverages::Empty;
+                all = all && coverage == Coverages::Full;
+              }
+          }
+        rows_.push_back( spans_.size() );
+
+        auto &coverage = blocks_[ static_cast< std::size_t >( index ) ];
+        if ( !any || all )
+          {
+            // Uniform blocks need no spans
+            coverage = any ? Coverages::Full : Coverages::Empty;
+            ++( any ? statistics_.fullBlocks : statistics_.emptyBlocks );
+            spans_.resize( first );
+            rows_.resize( firstRow );
+            values_.resize( firstValue );
+            return;
+          }
+        coverage = Coverages::Partial;
+        rowOffsets_[ static_cast< std::size_t >( index ) ] = firstRow;
+        ++statistics_.partialBlocks;
+      }
+
+    BlockGrid grid_{};
+    AccountedVector< Coverages > blocks_{};
+    AccountedVector< std::size_t > rowOffsets_{};
+    AccountedVector< std::size_t > rows_{};
+    AccountedVector< CoverageSpan > spans_{};
+    AccountedVector< UInt8 > values_{};
+    SelectionCoverageStatistics statistics_{};
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_selectioncoverage_hh_
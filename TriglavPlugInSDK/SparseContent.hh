@@ -0,0 +1,201 @@
+/// \file sparsecontent.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_sparsecontent_hh_
+#define cspsdkxx_triglavpluginsdk_sparsecontent_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+// Returns the first x in [ begin, end ) with a non-zero byte, or end; packed rows are scanned a word at a time
+inline auto findNonZero( UInt8 const *row, Int stride, Int begin, Int end ) noexcept -> Int
+  {
+    auto x = begin;
+    if ( stride == 1 )
+      {
+        for ( ; x + 8 <= end; x += 8 )
+          {
+            std::uint64_t word{};
+            std::memcpy( &word, row + x, sizeof( word ) );
+            if ( word )
+              { break; }
+          }
+      }
+    for ( ; x < end && !row[ x * stride ]; ++x )
+      {}
+    return x;
+  }
+
+// Returns one past the last x in [ begin, end ) with a non-zero byte, or begin
+inline auto findLastNonZero( UInt8 const *row, Int stride, Int begin, Int end ) noexcept -> Int
+  {
+    auto x = end;
+    if ( stride == 1 )
+      {
+        for ( ; begin + 8 <= x; x -= 8 )
+          {
+            std::uint64_t word{};
+            std::memcpy( &word, row + x - 8, sizeof( word ) );
+            if ( word )
+              { break; }
+          }
+      }
+    for ( ; begin < x && !row[ ( x - 1 ) * stride ]; --x )
+      {}
+    return x;
+  }
+
+// Clips rect to the painted extent of offscreen
+inline auto intersectExtent( Offscreen const &offscreen, Rect const &rect ) noexcept -> APIResult< Rect >
+  {
+    auto const extent = offscreen.getExtentRect();
+    if ( !extent )
+      { return extent.state(); }
+    auto const x = intersect( rect, *extent );
+    if ( isEmpty( x ) )
+      { return Rect{ rect.left, rect.top, rect.left, rect.top }; }
+    return x;
+  }
+
+
+struct ContentExtent
+  {
+    Int left;
+    Int right;
+  };
+
+struct SparseContentStatistics
+  {
+    std::size_t totalPixels;
+    std::size_t skippedPixels;
+
+    auto skippedFraction() const noexcept -> double
+      { return totalPixels ? static_cast< double >( skippedPixels ) / static_cast< double >( totalPixels ) : 0.0; }
+  };
+
+
+class SparseContent
+  {
+  public:
+    ~SparseContent() = default;
+    SparseContent() = default;
+    SparseContent( SparseContent const & ) = delete;
+    SparseContent( SparseContent && ) = default;
+    auto operator =( SparseContent const & ) -> SparseContent & = delete;
+    auto operator =( SparseContent && ) -> SparseContent & = default;
+
+    // Prepares the tables for grid; requested is the region before it was clipped to the extent.
+    // Blocks are scanned lazily by visit so no alpha is fetched ahead of the run
+    void make( Rect const &requested, BlockGrid const &grid )
+      {
+        grid_ = grid;
+        scanned_.assign( static_cast< std::size_t >( grid_.count() ), false );
+        transparent_.assign( static_cast< std::size_t >( grid_.count() ), false );
+        rowOffsets_.assign( static_cast< std::size_t >( grid_.count() ), 0 );
+        rows_.clear();
+
+        auto const &bounds = grid_.bounds();
+        statistics_.totalPixels = area( requested );
+        statistics_.skippedPixels = statistics_.totalPixels - ( grid_ ? area( bounds ) : 0 );
+      }
+
+    // Scans alpha the first time block index is visited; later visits ( after a restart ) reuse that scan,
+    // which stays valid because the host restores the destination before restarting.
+    // Returns false when the block has nothing painted
+    auto visit( Int index, ConstImageView< UInt8 > const &alpha ) -> bool
+      {
+        auto &&scanned = scanned_[ static_cast< std::size_t >( index ) ];
+        if ( !scanned )
+          {
+            scan( index, alpha );
+            scanned = true;
+          }
+        return !isTransparent( index );
+      }
+
+    void release() noexcept
+      { *this = SparseContent{}; }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto isTransparent( Int index ) const noexcept -> bool
+      { return transparent_[ static_cast< std::size_t >( index ) ]; }
+
+    // Painted extent of row y ( relative to the block ); only valid for visited blocks that are not transparent
+    auto row( Int index, Int y ) const noexcept -> ContentExtent
+      {
+        TP_ASSERT( scanned_[ static_cast< std::size_t >( index ) ] && !isTransparent( index ) );
+        return rows_[ rowOffsets_[ static_cast< std::size_t >( index ) ] + static_cast< std::size_t >( y ) ];
+      }
+
+    // Counts the pixels outside the extent plus the unpainted pixels of the blocks visited so far
+    auto statistics() const noexcept -> SparseContentStatistics const &
+      { return statistics_; }
+
+    auto report() const -> std::string
+      {
+        char line[ 128 ]{};
+        std::snprintf( line, sizeof( line ), "%-8s total %zu skipped %zu ( %.1f%% )\n", "sparse", statistics_.totalPixels, statistics_.skippedPixels, statistics_.skippedFraction() * 100.0 );
+        return line;
+      }
+
+  private:
+    void scan( Int index, ConstImageView< UInt8 > const &view )
+      {
+        auto const stride = view.pixelStride();
+        auto const first = rows_.size();
+        auto painted = std::size_t{};
+
+        for ( auto y = 0; y < view.height(); ++y )
+          {
+            auto const *p = view.row( y );
+            auto const left = findNonZero( p, stride, 0, view.width() );
+            auto const right = left < view.width() ? findLastNonZero( p, stride, left, view.width() ) : left;
+            rows_.push_back( ContentExtent{ left, right } );
+            painted += static_cast< std::size_t >( right - left );
+          }
+
+        statistics_.skippedPixels += static_cast< std::size_t >( view.width() ) * static_cast< std::size_t >( view.height() ) - painted;
+        if ( !painted )
+          {
+            transparent_[ static_cast< std::size_t >( index ) ] = true;
+            rows_.resize( first );
+            return;
+          }
+        rowOffsets_[ static_cast< std::size_t >( index ) ] = first;
+      }
+
+    BlockGrid grid_{};
+    AccountedVector< bool > scanned_{};
+    AccountedVector< bool > transparent_{};
+    AccountedVector< std::size_t > rowOffsets_{};
+    AccountedVector< ContentExtent > rows_{};
+    SparseContentStatistics statistics_{};
+  };
+
+
+inline void logSparseContent( SparseContent const &sparse )
+  {
+#if !defined( NDEBUG )
+    TP_LOG( sparse.report().c_str() );
+#endif // !defined( NDEBUG )
+  }
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_sparsecontent_hh_
@@ -0,0 +1,216 @@
+/// \file streaming.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_streaming_hh_
+#define cspsdkxx_triglavpluginsdk_streaming_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <TriglavPlugInSDK/Arena.hh>
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+struct StreamingOptions
+  {
+    std::size_t memoryBudgetBytes;
+    std::size_t bytesPerPixel;
+    Int haloRows;
+  };
+
+struct Band
+  {
+    Int firstRow;
+    Int rows;
+    Rect rect;
+    Rect haloRect;
+  };
+
+
+class BandPlan
+  {
+  public:
+    ~BandPlan() = default;
+    BandPlan() = default;
+    BandPlan( BandPlan const & ) = default;
+    BandPlan( BandPlan && ) = default;
+    auto operator =( BandPlan const & ) -> BandPlan & = default;
+    auto operator =( BandPlan && ) -> BandPlan & = default;
+
+    BandPlan( BlockGrid const &grid, StreamingOptions const &options )
+      : grid_{ grid }, options_{ options }, bands_{}, bandOfRows_{}, maxHaloHeight_{}, withinBudget_{ true }
+      {
+        auto const &bounds = grid_.bounds();
+        auto const rowBytes = static_cast< std::size_t >( bounds.right - bounds.left ) * options_.bytesPerPixel;
+        auto const budgetRows = rowBytes ? options_.memoryBudgetBytes / rowBytes : 0;
+
+        bandOfRows_.reserve( static_cast< std::size_t >( grid_.rows() ) );
+        for ( auto row = Int{}; row < grid_.rows(); )
+          {
+            Band band{ row, 0, grid_.rect( 0, row ), Rect{} };
+            for ( ; row < grid_.rows(); ++row )
+              {
+                auto const rect = grid_.rect( 0, row );
+                auto const haloRect = haloed( Rect{ band.rect.left, band.rect.top, band.rect.right, rect.bottom } );
+                if ( band.rows && budgetRows < static_cast< std::size_t >( haloRect.bottom - haloRect.top ) )
+                  { break; }
+                band.rect.bottom = rect.bottom;
+                band.haloRect = haloRect;
+                ++band.rows;
+                bandOfRows_.push_back( static_cast< Int >( bands_.size() ) );
+              }
+            band.rect.right = bounds.right;
+            band.haloRect.right = bounds.right;
+
+            auto const haloHeight = band.haloRect.bottom - band.haloRect.top;
+            maxHaloHeight_ = std::max( maxHaloHeight_, haloHeight );
+            if ( budgetRows < static_cast< std::size_t >( haloHeight ) )
+              { withinBudget_ = false; }
+            bands_.push_back( band );
+          }
+      }
+
+    explicit operator bool() const noexcept
+      { return !bands_.empty(); }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto options() const noexcept -> StreamingOptions const &
+      { return options_; }
+
+    auto count() const noexcept -> Int
+      { return static_cast< Int >( bands_.size() ); }
+
+    auto band( Int index ) const noexcept -> Band const &
+      { return bands_[ static_cast< std::size_t >( index ) ]; }
+
+    auto bandOfRow( Int row ) const noexcept -> Int
+      { return bandOfRows_[ static_cast< std::size_t >( row ) ]; }
+
+    auto bandOfBlock( Int index ) const noexcept -> Int
+      { return bandOfRow( grid_.row( index ) ); }
+
+    auto maxHaloHeight() const noexcept -> Int
+      { return maxHaloHeight_; }
+
+    auto bufferBytes() const noexcept -> std::size_t
+      {
+        auto const &bounds = grid_.bounds();
+        return static_cast< std::size_t >( bounds.right - bounds.left ) * static_cast< std::size_t >( maxHaloHeight_ ) * options_.bytesPerPixel;
+      }
+
+    auto withinBudget() const noexcept -> bool
+      { return withinBudget_; }
+
+  private:
+    auto haloed( Rect rect ) const noexcept -> Rect
+      {
+        auto const &bounds = grid_.bounds();
+        rect.top = std::max( rect.top - options_.haloRows, bounds.top );
+        rect.bottom = std::min( rect.bottom + options_.haloRows, bounds.bottom );
+        return rect;
+      }
+
+    BlockGrid grid_{};
+    StreamingOptions options_{};
+    std::vector< Band > bands_;
+    std::vector< Int > bandOfRows_;
+    Int maxHaloHeight_{};
+    bool withinBudget_{};
+  };
+
+
+template < class T >
+class BandBuffer
+  {
+  public:
+    ~BandBuffer() = default;
+    BandBuffer() noexcept : plan_{}, channels_{}, data_{}, current_{ -1 }, rect_{}, retainedRows_{} {}
+    BandBuffer( BandBuffer const & ) = delete;
+    BandBuffer( BandBuffer && ) = default;
+    auto operator =( BandBuffer const & ) -> BandBuffer & = delete;
+    auto operator =( BandBuffer && ) -> BandBuffer & = default;
+
+    auto make( MonotonicArena &arena, BandPlan const &plan, Int channels ) noexcept -> APIResult< void >
+      {
+        TP_ASSERT( plan.options().bytesPerPixel == sizeof( T ) * static_cast< std::size_t >( channels ) );
+        plan_ = &plan;
+        channels_ = channels;
+        current_ = -1;
+        rect_ = Rect{};
+        retainedRows_ = 0;
+        data_ = static_cast< T * >( arena.allocate( plan.bufferBytes(), kCacheLineBytes ) );
+        return data_ ? APIResults::Success : APIResults::Failed;
+      }
+
+    explicit operator bool() const noexcept
+      { return data_ != nullptr; }
+
+    auto enter( Int index ) noexcept -> Band const &
+      {
+        auto const &band = plan_->band( index );
+        if ( index == current_ )
+          { return band; }
+
+        // Only a band that follows a filled one can carry rows over
+        auto const &next = band.haloRect;
+        auto const overlap = current_ >= 0 && current_ + 1 == index ? std::max( rect_.bottom - next.top, 0 ) : 0;
+        if ( overlap )
+          { std::memmove( data_, row( next.top ), static_cast< std::size_t >( overlap ) * rowBytes() ); }
+
+        current_ = index;
+        rect_ = next;
+        retainedRows_ = overlap;
+        return band;
+      }
+
+    auto current() const noexcept -> Int
+      { return current_; }
+
+    auto rect() const noexcept -> Rect const &
+      { return rect_; }
+
+    auto retainedRows() const noexcept -> Int
+      { return retainedRows_; }
+
+    auto rowBytes() const noexcept -> std::size_t
+      { return static_cast< std::size_t >( rect_.right - rect_.left ) * sizeof( T ) * static_cast< std::size_t >( channels_ ); }
+
+    auto row( Int y ) const noexcept -> T *
+      {
+        TP_ASSERT( rect_.top <= y && y < rect_.bottom );
+        return reinterpret_cast< T * >( reinterpret_cast< Byte * >( data_ ) + static_cast< std::size_t >( y - rect_.top ) * rowBytes() );
+      }
+
+    auto view() const noexcept -> ImageView< T >
+      {
+        return ImageView< T >{
+          reinterpret_cast< Byte * >( data_ ),
+          static_cast< Int >( rowBytes() ),
+          static_cast< Int >( sizeof( T ) ) * channels_,
+          rect_.right - rect_.left,
+          rect_.bottom - rect_.top,
+        };
+      }
+
+  private:
+    BandPlan const *plan_;
+    Int channels_;
+    T *data_;
+    Int current_;
+    Rect rect_;
+    Int retainedRows_;
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_streaming_hh_
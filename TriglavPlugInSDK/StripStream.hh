@@ -0,0 +1,251 @@
+/// \file stripstream.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_stripstream_hh_
+#define cspsdkxx_triglavpluginsdk_stripstream_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <future>
+#include <system_error>
+#include <vector>
+
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+struct Strip
+  {
+    Int index;
+    Rect rect;
+    ImageView< UInt8 > view;
+    Int slot;
+
+    auto pixel( Int x, Int y ) const noexcept -> UInt8 *
+      { return view.pixel( x - rect.left, y - rect.top ); }
+  };
+
+
+class StripStream
+  {
+  public:
+    ~StripStream() = default;
+    StripStream() = default;
+    StripStream( StripStream const & ) = delete;
+    StripStream( StripStream && ) = delete;
+    auto operator =( StripStream const & ) -> StripStream & = delete;
+    auto operator =( StripStream && ) -> StripStream & = delete;
+
+    // prefetch() copies smaller strips inline, since starting a thread costs more than the copy
+    constexpr static std::size_t kMinAsyncBytes = 1 << 20;
+
+    // Choose stripRows so that a strip spans at least kMinAsyncBytes when prefetch() should overlap the copy
+    auto make( Offscreen const &offscreen, BlockPlanes plane, Rect const &bounds, Int stripRows ) -> APIResult< void >
+      {
+        TP_ASSERT( plane == BlockPlanes::Image || plane == BlockPlanes::Alpha );
+        TP_ASSERT( stripRows > 0 );
+
+        // A prefetch still in flight writes into the buffers about to be replaced
+        for ( auto &&x : slots_ )
+          { wait( x ); }
+
+        BlockGrid grid{};
+        if ( !grid.make( offscreen, bounds ) || !grid )
+          { return APIResults::Failed; }
+
+        offscreen_ = offscreen;
+        grid_ = grid;
+        plane_ = plane;
+        stripRows_ = stripRows;
+
+        auto const block = fetchBlock( grid_.rect( 0 ) );
+        if ( !block )
+          { return APIResults::Failed; }
+        pixelBytes_ = block->pixelBytes;
+
+        auto const &rect = grid_.bounds();
+        auto const bytes = static_cast< std::size_t >( ( rect.right - rect.left ) * pixelBytes_ ) * static_cast< std::size_t >( stripRows_ );
+        for ( auto &&x : slots_ )
+          {
+            x.index = -1;
+            x.buffer.assign( bytes, 0 );
+            x.segments.clear();
+          }
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( grid_ ); }
+
+    auto count() const noexcept -> Int
+      {
+        auto const &rect = grid_.bounds();
+        return ( rect.bottom - rect.top + stripRows_ - 1 ) / stripRows_;
+      }
+
+    auto rect( Int index ) const noexcept -> Rect
+      {
+        auto const &bounds = grid_.bounds();
+        auto const top = bounds.top + index * stripRows_;
+        return Rect{ bounds.left, top, bounds.right, std::min( top + stripRows_, bounds.bottom ) };
+      }
+
+    // Starts filling the other slot, on a worker thread for strips of at least kMinAsyncBytes; the strip previously read into that slot must already be written back
+    auto prefetch( Int index ) -> APIResult< void >
+      {
+        if ( index < 0 || count() <= index )
+          { return APIResults::Failed; }
+
+        auto &slot = slots_[ static_cast< std::size_t >( index % 2 ) ];
+        if ( slot.index == index )
+          { return APIResults::Success; }
+        wait( slot );
+        if ( !resolve( slot, index ) )
+          { return APIResults::Failed; }
+
+        if ( slot.buffer.size() < kMinAsyncBytes )
+          { copyIn( slot ); }
+        else
+          {
+            try
+              { slot.pending = std::async( std::launch::async, [ this, &slot ]{ copyIn( slot ); } ); }
+            catch ( std::system_error const & )
+              { copyIn( slot ); }
+          }
+        return APIResults::Success;
+      }
+
+    auto read( Int index ) -> APIResult< Strip >
+      {
+        if ( index < 0 || count() <= index )
+          { return APIResults::Failed; }
+
+        auto &slot = slots_[ static_cast< std::size_t >( index % 2 ) ];
+        wait( slot );
+        if ( slot.index != index )
+          {
+            if ( !resolve( slot, index ) )
+              { return APIResults::Failed; }
+            copyIn( slot );
+          }
+        return makeStrip( slot, index % 2 );
+      }
+
+    auto write( Strip const &strip ) noexcept -> APIResult< void >
+      {
+        auto &slot = slots_[ static_cast< std::size_t >( strip.slot ) ];
+        if ( slot.index != strip.index )
+          { return APIResults::Failed; }
+
+        auto const bytes = rowBytes();
+        for ( auto &&x : slot.segments )
+          {
+            auto const block = makeImageView< UInt8 >( x.block, x.blockRect );
+            auto const n = static_cast< std::size_t >( ( x.rect.right - x.rect.left ) * pixelBytes_ );
+            for ( auto y = x.rect.top; y < x.rect.bottom; ++y )
+              {
+                auto const source = slot.buffer.data() + static_cast< std::size_t >( y - strip.rect.top ) * bytes + static_cast< std::size_t >( ( x.rect.left - strip.rect.left ) * pixelBytes_ );
+                std::memcpy( block.pixel( x.rect.left - x.blockRect.left, y - x.blockRect.top ), source, n );
+              }
+          }
+        return APIResults::Success;
+      }
+
+  private:
+    struct Segment
+      {
+        Offscreen::MutableBlock block;
+        Rect blockRect;
+        Rect rect;
+      };
+
+    struct Slot
+      {
+        Int index = -1;
+        std::vector< UInt8 > buffer;
+        std::vector< Segment > segments;
+        std::future< void > pending;
+      };
+
+    auto fetchBlock( Rect const &rect ) const noexcept -> APIResult< Offscreen::MutableBlock >
+      {
+        Point const pos{ rect.left, rect.top };
+        return plane_ == BlockPlanes::Image ? offscreen_.getMutableBlockImage( pos ) : offscreen_.getMutableBlockAlpha( pos );
+      }
+
+    auto rowBytes() const noexcept -> std::size_t
+      {
+        auto const &rect = grid_.bounds();
+        return static_cast< std::size_t >( ( rect.right - rect.left ) * pixelBytes_ );
+      }
+
+    auto resolve( Slot &slot, Int index ) -> bool
+      {
+        auto const r = rect( index );
+        slot.index = -1;
+        slot.segments.clear();
+
+        auto const first = grid_.row( grid_.indexAt( Point{ r.left, r.top } ) );
+        auto const last = grid_.row( grid_.indexAt( Point{ r.left, r.bottom - 1 } ) );
+        for ( auto row = first; row <= last; ++row )
+          {
+            for ( auto column = 0; column < grid_.columns(); ++column )
+              {
+                auto const blockRect = grid_.rect( column, row );
+                auto const block = fetchBlock( blockRect );
+                if ( !block || block->pixelBytes != pixelBytes_ )
+                  { return false; }
+                Rect const x{ blockRect.left, std::max( blockRect.top, r.top ), blockRect.right, std::min( blockRect.bottom, r.bottom ) };
+                slot.segments.push_back( Segment{ *block, blockRect, x } );
+              }
+          }
+        slot.index = index;
+        return true;
+      }
+
+    void copyIn( Slot &slot ) const noexcept
+      {
+        auto const r = rect( slot.index );
+        auto const bytes = rowBytes();
+        for ( auto &&x : slot.segments )
+          {
+            auto const block = makeImageView< UInt8 >( x.block, x.blockRect );
+            auto const n = static_cast< std::size_t >( ( x.rect.right - x.rect.left ) * pixelBytes_ );
+            for ( auto y = x.rect.top; y < x.rect.bottom; ++y )
+              {
+                auto const destination = slot.buffer.data() + static_cast< std::size_t >( y - r.top ) * bytes + static_cast< std::size_t >( ( x.rect.left - r.left ) * pixelBytes_ );
+                std::memcpy( destination, block.pixel( x.rect.left - x.blockRect.left, y - x.blockRect.top ), n );
+              }
+          }
+      }
+
+    static void wait( Slot &slot )
+      {
+        if ( slot.pending.valid() )
+          { slot.pending.get(); }
+      }
+
+    auto makeStrip( Slot &slot, Int slotIndex ) noexcept -> Strip
+      {
+        auto const r = rect( slot.index );
+        ImageView< UInt8 > const view{ reinterpret_cast< Byte * >( slot.buffer.data() ), static_cast< Int >( rowBytes() ), pixelBytes_, r.right - r.left, r.bottom - r.top };
+        return Strip{ slot.index, r, view, slotIndex };
+      }
+
+    Offscreen offscreen_{};
+    BlockGrid grid_{};
+    BlockPlanes plane_{};
+    Int stripRows_{ 1 };
+    Int pixelBytes_{};
+    Slot slots_[ 2 ]{};
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_stripstream_hh_
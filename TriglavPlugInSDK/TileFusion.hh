@@ -0,0 +1,275 @@
+/// \file tilefusion.hh
+///
+/// \copyright (C) 2017 tempura-sukiyaki
+///
+
+#ifndef cspsdkxx_triglavpluginsdk_tilefusion_hh_
+#define cspsdkxx_triglavpluginsdk_tilefusion_hh_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if defined( __APPLE__ )
+# include <sys/sysctl.h>
+#elif defined( __linux__ )
+# include <unistd.h>
+#endif
+
+#include <TriglavPlugInSDK/HaloFetcher.hh>
+#include <TriglavPlugInSDK/ImageView.hh>
+#include <TriglavPlugInSDK/TriglavPlugInSDK.hh>
+
+
+namespace Triglav { namespace PlugIn {
+
+
+constexpr std::size_t kDefaultCacheBytes = 256 * 1024;
+constexpr Int kMinSubTileSize = 16;
+
+
+// Size of the per-core L2 cache, or kDefaultCacheBytes when the platform does not tell
+inline auto detectCacheBytes() noexcept -> std::size_t
+  {
+#if defined( __APPLE__ )
+    std::uint64_t x{};
+    auto size = sizeof( x );
+    if ( !::sysctlbyname( "hw.l2cachesize", &x, &size, nullptr, 0 ) && x )
+      { return static_cast< std::size_t >( x ); }
+#elif defined( __linux__ ) && defined( _SC_LEVEL2_CACHE_SIZE )
+    auto const x = ::sysconf( _SC_LEVEL2_CACHE_SIZE );
+    if ( x > 0 )
+      { return static_cast< std::size_t >( x ); }
+#endif
+    return kDefaultCacheBytes;
+  }
+
+
+// source is destination grown by radius on every side
+struct FusedStage
+  {
+    using Function = std::function< void( ConstImageView< UInt8 > const &source, ImageView< UInt8 > const &destination ) >;
+
+    Int radius;
+    Int pixelBytes;
+    Function function;
+  };
+
+struct FusedExecutorStatistics
+  {
+    std::size_t subTiles;
+    std::size_t outputPixels;
+    std::size_t computedPixels;
+  };
+
+
+// Runs a chain of stages on cache-sized sub-tiles of each block, recomputing the overlap instead of storing full intermediates
+class FusedExecutor
+  {
+  public:
+    ~FusedExecutor() = default;
+    FusedExecutor() = default;
+    FusedExecutor( FusedExecutor const & ) = delete;
+    FusedExecutor( FusedExecutor && ) = default;
+    auto operator =( FusedExecutor const & ) -> FusedExecutor & = delete;
+    auto operator =( FusedExecutor && ) -> FusedExecutor & = default;
+
+    // Stages read from source and the last one writes into the destination block; the input of every stage is padded at the image bounds.
+    // Source must not be written during execute, so in-place filters write into another offscreen
+    auto make( std::weak_ptr< Server const > const &server, Offscreen const &source, BlockPlanes plane, std::vector< FusedStage > stages, EdgePolicies policy = EdgePolicies::Clamp, std::size_t cacheBytes = 0 ) -> APIResult< void >
+      {
+        if ( stages.empty() )
+          { return APIResults::Failed; }
+
+        auto const tileWidth = source.getTileWidth();
+        auto const tileHeight = source.getTileHeight();
+        if ( !tileWidth || !tileHeight )
+          { return APIResults::Failed; }
+
+        auto radius = Int{};
+        for ( auto &&x : stages )
+          {
+            TP_ASSERT( x.radius >= 0 && x.function );
+            radius += x.radius;
+          }
+
+        if ( !fetcher_.make( server, source, plane, radius, policy ) )
+          { return APIResults::Failed; }
+
+        sourceBytes_ = fetcher_.pixelBytes();
+        stages_ = std::move( stages );
+        radius_ = radius;
+        chooseSubTile( *tileWidth, *tileHeight, cacheBytes ? cacheBytes : detectCacheBytes() );
+
+        auto bytes = std::size_t{};
+        auto remaining = radius_;
+        for ( auto &&x : stages_ )
+          {
+            remaining -= x.radius;
+            bytes = std::max( bytes, area( Rect{ 0, 0, subTileWidth_ + remaining * 2, subTileHeight_ + remaining * 2 } ) * static_cast< std::size_t >( outputBytes( x ) ) );
+          }
+        for ( auto &&x : buffers_ )
+          { x.assign( bytes, 0 ); }
+
+        statistics_ = FusedExecutorStatistics{};
+        return APIResults::Success;
+      }
+
+    explicit operator bool() const noexcept
+      { return !stages_.empty() && static_cast< bool >( fetcher_ ); }
+
+    auto radius() const noexcept -> Int
+      { return radius_; }
+
+    auto subTileWidth() const noexcept -> Int
+      { return subTileWidth_; }
+
+    auto subTileHeight() const noexcept -> Int
+      { return subTileHeight_; }
+
+    auto statistics() const noexcept -> FusedExecutorStatistics const &
+      { return statistics_; }
+
+    // Runs every stage over rect, one sub-tile at a time; target views the destination pixels of rect
+    auto execute( Rect const &rect, ImageView< UInt8 > const &target ) -> APIResult< void >
+      {
+        TP_ASSERT( target.pixelBytes() == outputBytes( stages_.back() ) );
+
+#if !defined( NDEBUG )
+        // Computed before target is written
+        std::vector< UInt8 > expected{};
+        auto const sequential = executeSequential( rect, expected );
+#endif // !defined( NDEBUG )
+
+        fetcher_.invalidate();
+        for ( auto top = rect.top; top < rect.bottom; top += subTileHeight_ )
+          {
+            for ( auto left = rect.left; left < rect.right; left += subTileWidth_ )
+              {
+                Rect const r{ left, top, std::min( left + subTileWidth_, rect.right ), std::min( top + subTileHeight_, rect.bottom ) };
+                if ( !executeTile( r, target.sub( r.left - rect.left, r.top - rect.top, r.right - r.left, r.bottom - r.top ), buffers_ ) )
+                  { return APIResults::Failed; }
+                ++statistics_.subTiles;
+                statistics_.outputPixels += area( r );
+              }
+          }
+
+#if !defined( NDEBUG )
+        TP_ASSERT( !sequential || matches( target, expected ) );
+#endif // !defined( NDEBUG )
+        return APIResults::Success;
+      }
+
+    // Runs each stage over the whole of rect in turn, as separate full passes would; rect must fit in one block
+    auto executeSequential( Rect const &rect, std::vector< UInt8 > &output ) -> APIResult< void >
+      {
+        auto const bytes = outputBytes( stages_.back() );
+        auto const width = rect.right - rect.left;
+        output.assign( area( rect ) * static_cast< std::size_t >( bytes ), 0 );
+
+        std::vector< UInt8 > buffers[ 2 ]{};
+        auto const statistics = statistics_;
+        fetcher_.invalidate();
+        auto const result = executeTile( rect, ImageView< UInt8 >{ reinterpret_cast< Byte * >( output.data() ), width * bytes, bytes, width, rect.bottom - rect.top }, buffers );
+        fetcher_.invalidate();
+        statistics_ = statistics;
+        return result ? APIResults::Success : APIResults::Failed;
+      }
+
+  private:
+    auto executeTile( Rect const &rect, ImageView< UInt8 > const &target, std::vector< UInt8 > ( &buffers )[ 2 ] ) -> bool
+      {
+        auto const tile = fetcher_.fetch( rect );
+        if ( !tile )
+          { return false; }
+
+        auto const width = rect.right - rect.left;
+        auto const height = rect.bottom - rect.top;
+        ConstImageView< UInt8 > source = tile->view;
+        auto remaining = radius_;
+        for ( std::size_t i = 0; i < stages_.size(); ++i )
+          {
+            auto const &stage = stages_[ i ];
+            remaining -= stage.radius;
+            auto const w = width + remaining * 2;
+            auto const h = height + remaining * 2;
+            auto const bytes = outputBytes( stage );
+
+            auto destination = target;
+            if ( i + 1 < stages_.size() )
+              {
+                auto &buffer = buffers[ i % 2 ];
+                auto const size = static_cast< std::size_t >( w * h * bytes );
+                if ( buffer.size() < size )
+                  { buffer.resize( size ); }
+                destination = ImageView< UInt8 >{ reinterpret_cast< Byte * >( buffer.data() ), w * bytes, bytes, w, h };
+              }
+            stage.function( source, destination );
+            statistics_.computedPixels += area( Rect{ 0, 0, w, h } );
+
+            // Intermediates beyond the image are padded from their own pixels, as a full pass would pad its input
+            if ( i + 1 < stages_.size() )
+              {
+                Rect const r{ rect.left - remaining, rect.top - remaining, rect.right + remaining, rect.bottom + remaining };
+                auto const valid = intersect( r, fetcher_.bounds() );
+                if ( !isEmpty( valid ) )
+                  { padEdges( destination, r, valid, fetcher_.policy() ); }
+              }
+            source = destination;
+          }
+        return true;
+      }
+
+    static auto matches( ImageView< UInt8 > const &view, std::vector< UInt8 > const &pixels ) noexcept -> bool
+      {
+        auto const bytes = static_cast< std::size_t >( view.width() * view.pixelBytes() );
+        for ( auto y = 0; y < view.height(); ++y )
+          {
+            for ( std::size_t x = 0; x < bytes; ++x )
+              {
+                if ( view.row( y )[ x ] != pixels[ static_cast< std::size_t >( y ) * bytes + x ] )
+                  { return false; }
+              }
+          }
+        return true;
+      }
+
+    void chooseSubTile( Int tileWidth, Int tileHeight, std::size_t cacheBytes ) noexcept
+      {
+        // Keep the halo tile and both intermediates within half of the cache
+        auto perPixel = static_cast< std::size_t >( sourceBytes_ );
+        for ( auto &&x : stages_ )
+          { perPixel += static_cast< std::size_t >( outputBytes( x ) ); }
+
+        auto w = tileWidth;
+        auto h = tileHeight;
+        while ( area( Rect{ 0, 0, w + radius_ * 2, h + radius_ * 2 } ) * perPixel > cacheBytes / 2 && ( w > kMinSubTileSize || h > kMinSubTileSize ) )
+          {
+            if ( w >= h )
+              { w = std::max( kMinSubTileSize, w / 2 ); }
+            else
+              { h = std::max( kMinSubTileSize, h / 2 ); }
+          }
+        subTileWidth_ = w;
+        subTileHeight_ = h;
+      }
+
+    auto outputBytes( FusedStage const &stage ) const noexcept -> Int
+      { return stage.pixelBytes ? stage.pixelBytes : sourceBytes_; }
+
+    HaloFetcher fetcher_{};
+    std::vector< FusedStage > stages_{};
+    Int radius_{};
+    Int sourceBytes_{};
+    Int subTileWidth_{};
+    Int subTileHeight_{};
+    std::vector< UInt8 > buffers_[ 2 ]{};
+    FusedExecutorStatistics statistics_{};
+  };
+
+}} // namespace Triglav::PlugIn
+
+#endif // cspsdkxx_triglavpluginsdk_tilefusion_hh_
@@ -11,6 +11,11 @@
 # define TP_ASSERT( condition ) assert( condition )
 #endif // !defined( TP_ASSERT )
 
+#if !defined( TP_LOG )
+# include <cstdio>
+# define TP_LOG( message ) std::fputs( ( message ), stderr )
+#endif // !defined( TP_LOG )
+
 #define TP_EXTERN_C_START TRIGLAV_PLUGIN_EXTERN_C_START
 #define TP_EXTERN_C_END TRIGLAV_PLUGIN_EXTERN_C_END
 #define TP_API TRIGLAV_PLUGIN_API
@@ -22,9 +27,20 @@
 # define TP_ACTIVATION 0
 #endif // !defined( TRIGLAV_PLUGIN_ACTIVATION )
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <TriglavPlugInSDK/TriglavPlugInSDK.h>
 
@@ -53,6 +69,9 @@ constexpr auto toByte( UInt8 x ) noexcept -> Byte
   { return static_cast< Byte >( x ); }
 
 
+using UInt16 = std::uint16_t;
+
+
 using Int = TriglavPlugInInt;
 using Integer = Int;
 
@@ -83,6 +102,34 @@ using Size = TriglavPlugInSize;
 
 using Rect = TriglavPlugInRect;
 
+constexpr auto isEmpty( Rect const &x ) noexcept -> bool
+  { return x.right <= x.left || x.bottom <= x.top; }
+
+constexpr auto area( Rect const &x ) noexcept -> std::size_t
+  { return isEmpty( x ) ? 0 : static_cast< std::size_t >( x.right - x.left ) * static_cast< std::size_t >( x.bottom - x.top ); }
+
+// May be empty; callers test with isEmpty
+constexpr auto intersect( Rect const &a, Rect const &b ) noexcept -> Rect
+  {
+    return Rect{
+      a.left < b.left ? b.left : a.left,
+      a.top < b.top ? b.top : a.top,
+      a.right < b.right ? a.right : b.right,
+      a.bottom < b.bottom ? a.bottom : b.bottom,
+    };
+  }
+
+// Bounding rect of both; an empty rect contributes nothing
+constexpr auto unite( Rect const &a, Rect const &b ) noexcept -> Rect
+  {
+    return isEmpty( a ) ? b : isEmpty( b ) ? a : Rect{
+      a.left < b.left ? a.left : b.left,
+      a.top < b.top ? a.top : b.top,
+      a.right < b.right ? b.right : a.right,
+      a.bottom < b.bottom ? b.bottom : a.bottom,
+    };
+  }
+
 
 using RGBColor = TriglavPlugInRGBColor;
 
@@ -154,133 +201,187 @@ constexpr auto isSuccess( APIResults result ) noexcept -> bool
 
 
 template < class T >
-class APIResult
+struct IsTrivialAPIResultValue
+  : std::integral_constant< bool,
+      std::is_trivially_copy_constructible< T >::value &&
+      std::is_trivially_move_constructible< T >::value &&
+      std::is_trivially_copy_assignable< T >::value &&
+      std::is_trivially_move_assignable< T >::value &&
+      std::is_trivially_destructible< T >::value > {};
+
+template < class T > class APIResult;
+
+template < class T, bool = IsTrivialAPIResultValue< T >::value >
+class APIResultStorage
   {
   public:
     template < class Y > friend class APIResult;
 
-    using Value = T;
-
-    ~APIResult() { unset(); }
-    constexpr APIResult() noexcept
+    ~APIResultStorage() { unset(); }
+    constexpr APIResultStorage() noexcept
       : state_{ APIResults::Failed }, dummy_{} {}
-    constexpr APIResult( APIResult const &x ) { set( x ); }
-    constexpr APIResult( APIResult &&x ) { set( std::move( x ) ); }
+    constexpr APIResultStorage( APIResultStorage const &x ) { set( x ); }
+    constexpr APIResultStorage( APIResultStorage &&x ) { set( std::move( x ) ); }
 
-    constexpr auto operator =( APIResult const &x ) -> APIResult &
+    constexpr auto operator =( APIResultStorage const &x ) -> APIResultStorage &
       {
         unset();
         set( x );
         return *this;
       }
 
-    constexpr auto operator =( APIResult &&x ) -> APIResult &
+    constexpr auto operator =( APIResultStorage &&x ) -> APIResultStorage &
       {
         unset();
         set( std::move( x ) );
         return *this;
       }
 
-    constexpr APIResult( APIResults x )
-      : state_{ x }, dummy_{} {}
-
-    constexpr APIResult( Value const &x )
-      : state_{ APIResults::Success }, dummy_{}
-      { new ( &value_ ) Value{ x }; }
+    constexpr APIResultStorage( APIResults s )
+      : state_{ s }, dummy_{} {}
 
-    constexpr APIResult( Value &&x )
-      : state_{ APIResults::Success }, dummy_{}
-      { new ( &value_ ) Value{ std::move( x ) }; }
-
-    constexpr APIResult( APIResults s, Value const &x )
+    constexpr APIResultStorage( APIResults s, T const &x )
       : state_{ s }, dummy_{}
       {
         if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ x }; }
+          { new ( &value_ ) T{ x }; }
       }
 
-    constexpr APIResult( APIResults s, Value &&x )
+    constexpr APIResultStorage( APIResults s, T &&x )
       : state_{ s }, dummy_{}
       {
         if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ std::move( x ) }; }
+          { new ( &value_ ) T{ std::move( x ) }; }
       }
 
+  protected:
+    constexpr void set( APIResultStorage const &x )
+      {
+        state_ = x.state_;
+        if ( isSuccess( state_ ) )
+          { new ( &value_ ) T{ x.value_ }; }
+      }
+    constexpr void set( APIResultStorage &&x )
+      {
+        state_ = x.state_;
+        if ( isSuccess( state_ ) )
+          { new ( &value_ ) T{ std::move( x.value_ ) }; }
+      }
+    constexpr void unset() noexcept
+      {
+        if ( isSuccess( state_ ) )
+          { value_.~T(); }
+        dummy_ = false;
+      }
+
+    APIResults state_;
+    union { bool dummy_; T value_; };
+  };
+
+template < class T >
+class APIResultStorage< T, true >
+  {
+  public:
+    template < class Y > friend class APIResult;
+
+    ~APIResultStorage() = default;
+    constexpr APIResultStorage() noexcept
+      : state_{ APIResults::Failed }, dummy_{} {}
+    APIResultStorage( APIResultStorage const & ) = default;
+    APIResultStorage( APIResultStorage && ) = default;
+    auto operator =( APIResultStorage const & ) -> APIResultStorage & = default;
+    auto operator =( APIResultStorage && ) -> APIResultStorage & = default;
+
+    constexpr APIResultStorage( APIResults s ) noexcept
+      : state_{ s }, dummy_{} {}
+
+    constexpr APIResultStorage( APIResults s, T const &x ) noexcept
+      : state_{ s }, value_( x ) {}
+
+  protected:
+    constexpr void unset() noexcept {}
+
+    APIResults state_;
+    union { bool dummy_; T value_; };
+  };
+
+template < class T >
+class APIResult : public APIResultStorage< T >
+  {
+  public:
+    template < class Y > friend class APIResult;
+
+    using Value = T;
+
+    constexpr APIResult() noexcept = default;
+
+    constexpr APIResult( APIResults x )
+      : APIResultStorage< T >{ x } {}
+
+    constexpr APIResult( Value const &x )
+      : APIResultStorage< T >{ APIResults::Success, x } {}
+
+    constexpr APIResult( Value &&x )
+      : APIResultStorage< T >{ APIResults::Success, std::move( x ) } {}
+
+    constexpr APIResult( APIResults s, Value const &x )
+      : APIResultStorage< T >{ s, x } {}
+
+    constexpr APIResult( APIResults s, Value &&x )
+      : APIResultStorage< T >{ s, std::move( x ) } {}
+
     template < class Y >
     constexpr APIResult( APIResult< Y > &&x )
-      : state_{ x.state_ }, dummy_{}
+      : APIResultStorage< T >{ x.state_ }
       {
-        if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ std::forward< Y >( x.value_ ) }; }
+        if ( isSuccess( this->state_ ) )
+          { new ( &this->value_ ) Value{ std::forward< Y >( x.value_ ) }; }
       }
 
     constexpr explicit operator bool() const noexcept
-      { return isSuccess( state_ ); }
+      { return isSuccess( this->state_ ); }
 
     constexpr auto operator *() const & noexcept -> Value const &
-      { return value_; }
+      { return this->value_; }
 
     constexpr auto operator *() && noexcept -> Value
-      { return std::move( value_ ); }
+      { return std::move( this->value_ ); }
 
     constexpr auto operator->() const & noexcept -> Value const *
-      { return &value_; }
+      { return &this->value_; }
 
     constexpr auto operator->() && noexcept -> Value const * = delete;
 
     constexpr auto state() const noexcept -> APIResults
-      { return state_; }
+      { return this->state_; }
 
     constexpr auto value() const & noexcept -> Value const &
-      { return value_; }
+      { return this->value_; }
 
     constexpr auto value() && noexcept -> Value
-      { return std::move( value_ ); }
+      { return std::move( this->value_ ); }
 
     constexpr void reset( APIResults s )
       {
-        unset();
-        state_ = s;
+        this->unset();
+        this->state_ = s;
       }
 
     constexpr void reset( APIResults s, Value const &x )
       {
-        unset();
-        state_ = s;
-        if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ x }; }
+        this->unset();
+        this->state_ = s;
+        if ( isSuccess( this->state_ ) )
+          { new ( &this->value_ ) Value{ x }; }
       }
 
     constexpr void reset( APIResults s, Value &&x )
       {
-        unset();
-        state_ = s;
-        if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ std::move( x ) }; }
-      }
-
-  private:
-    constexpr void set( APIResult const &x )
-      {
-        state_ = x.state_;
-        if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ x.value_ }; }
-      }
-    constexpr void set( APIResult &&x )
-      {
-        state_ = x.state_;
-        if ( isSuccess( state_ ) )
-          { new ( &value_ ) Value{ std::move( x.value_ ) }; }
-      }
-    constexpr void unset() noexcept
-      {
-        if ( isSuccess( state_ ) )
-          { value_.~Value(); }
-        dummy_ = false;
+        this->unset();
+        this->state_ = s;
+        if ( isSuccess( this->state_ ) )
+          { new ( &this->value_ ) Value{ std::move( x ) }; }
       }
-
-    APIResults state_;
-    union { bool dummy_; T value_; };
   };
 
 template <>
@@ -310,6 +411,230 @@ class APIResult< void >
     APIResults state_;
   };
 
+static_assert( std::is_trivially_copyable< APIResult< Int > >::value, "APIResult< Int > must be trivially copyable" );
+static_assert( std::is_trivially_copyable< APIResult< Rect > >::value, "APIResult< Rect > must be trivially copyable" );
+
+
+enum class MemoryCategories : UInt8
+  {
+    Scratch,
+    Caches,
+    Pools,
+  };
+
+constexpr std::size_t kMemoryCategoryCount = 3;
+
+struct MemoryUsage
+  {
+    std::size_t current;
+    std::size_t peak;
+    std::size_t allocations;
+  };
+
+struct HostObjectUsage
+  {
+    std::size_t created;
+    std::size_t retained;
+    std::size_t released;
+    std::size_t live;
+    std::size_t peakLive;
+  };
+
+
+class MemoryAccounting
+  {
+  public:
+    static auto instance() noexcept -> MemoryAccounting &
+      {
+        static MemoryAccounting x{};
+        return x;
+      }
+
+    ~MemoryAccounting() = default;
+    MemoryAccounting( MemoryAccounting const & ) = delete;
+    MemoryAccounting( MemoryAccounting && ) = delete;
+    auto operator =( MemoryAccounting const & ) -> MemoryAccounting & = delete;
+    auto operator =( MemoryAccounting && ) -> MemoryAccounting & = delete;
+
+    // The counters only move when TP_MEMORY_ACCOUNTING is defined; otherwise these hooks are empty
+#if defined( TP_MEMORY_ACCOUNTING )
+    void allocate( MemoryCategories category, std::size_t bytes ) noexcept
+      {
+        counters_[ static_cast< std::size_t >( category ) ].add( bytes );
+        total_.add( bytes );
+      }
+
+    void deallocate( MemoryCategories category, std::size_t bytes ) noexcept
+      {
+        counters_[ static_cast< std::size_t >( category ) ].subtract( bytes );
+        total_.subtract( bytes );
+      }
+
+    void hostObjectCreated( bool owned ) noexcept
+      {
+        ++( owned ? created_ : retained_ );
+        updatePeak( peakLive_, ++live_ );
+      }
+
+    void hostObjectReleased() noexcept
+      {
+        ++released_;
+        --live_;
+      }
+#else
+    void allocate( MemoryCategories, std::size_t ) noexcept {}
+    void deallocate( MemoryCategories, std::size_t ) noexcept {}
+    void hostObjectCreated( bool ) noexcept {}
+    void hostObjectReleased() noexcept {}
+#endif // defined( TP_MEMORY_ACCOUNTING )
+
+    void beginRun() noexcept
+      {
+        for ( auto &&x : counters_ )
+          { x.restart(); }
+        total_.restart();
+        created_ = 0;
+        retained_ = 0;
+        released_ = 0;
+        peakLive_ = live_.load();
+      }
+
+    auto usage( MemoryCategories category ) const noexcept -> MemoryUsage
+      { return counters_[ static_cast< std::size_t >( category ) ].usage(); }
+
+    auto total() const noexcept -> MemoryUsage
+      { return total_.usage(); }
+
+    auto hostObjects() const noexcept -> HostObjectUsage
+      { return HostObjectUsage{ created_.load(), retained_.load(), released_.load(), live_.load(), peakLive_.load() }; }
+
+    auto report() const -> std::string
+      {
+        static char const *const names[ kMemoryCategoryCount ] = { "scratch", "caches", "pools" };
+
+        std::string result{};
+        char line[ 128 ]{};
+        for ( std::size_t i = 0; i < kMemoryCategoryCount; ++i )
+          {
+            auto const x = counters_[ i ].usage();
+            std::snprintf( line, sizeof( line ), "%-8s current %zu peak %zu allocations %zu\n", names[ i ], x.current, x.peak, x.allocations );
+            result += line;
+          }
+        auto const x = total();
+        std::snprintf( line, sizeof( line ), "%-8s current %zu peak %zu allocations %zu\n", "total", x.current, x.peak, x.allocations );
+        result += line;
+        auto const y = hostObjects();
+        std::snprintf( line, sizeof( line ), "%-8s created %zu retained %zu released %zu live %zu peak %zu\n", "objects", y.created, y.retained, y.released, y.live, y.peakLive );
+        result += line;
+        return result;
+      }
+
+  private:
+    class Counter
+      {
+      public:
+        void add( std::size_t bytes ) noexcept
+          {
+            ++allocations_;
+            updatePeak( peak_, current_ += bytes );
+          }
+
+        void subtract( std::size_t bytes ) noexcept
+          { current_ -= bytes; }
+
+        void restart() noexcept
+          {
+            peak_ = current_.load();
+            allocations_ = 0;
+          }
+
+        auto usage() const noexcept -> MemoryUsage
+          { return MemoryUsage{ current_.load(), peak_.load(), allocations_.load() }; }
+
+      private:
+        std::atomic< std::size_t > current_{};
+        std::atomic< std::size_t > peak_{};
+        std::atomic< std::size_t > allocations_{};
+      };
+
+    MemoryAccounting() = default;
+
+    static void updatePeak( std::atomic< std::size_t > &peak, std::size_t x ) noexcept
+      {
+        auto y = peak.load();
+        while ( y < x && !peak.compare_exchange_weak( y, x ) ) {}
+      }
+
+    Counter counters_[ kMemoryCategoryCount ];
+    Counter total_;
+    std::atomic< std::size_t > created_{};
+    std::atomic< std::size_t > retained_{};
+    std::atomic< std::size_t > released_{};
+    std::atomic< std::size_t > live_{};
+    std::atomic< std::size_t > peakLive_{};
+  };
+
+inline void logMemoryAccounting()
+  {
+#if defined( TP_MEMORY_ACCOUNTING )
+    TP_LOG( MemoryAccounting::instance().report().c_str() );
+#endif // defined( TP_MEMORY_ACCOUNTING )
+  }
+
+
+// std::allocator that reports what it holds to MemoryAccounting under Category
+template < class T, MemoryCategories Category = MemoryCategories::Scratch >
+class AccountedAllocator
+  {
+  public:
+    using value_type = T;
+
+    template < class Y >
+    struct rebind
+      { using other = AccountedAllocator< Y, Category >; };
+
+    ~AccountedAllocator() = default;
+    AccountedAllocator() = default;
+    AccountedAllocator( AccountedAllocator const & ) = default;
+    AccountedAllocator( AccountedAllocator && ) = default;
+    auto operator =( AccountedAllocator const & ) -> AccountedAllocator & = default;
+    auto operator =( AccountedAllocator && ) -> AccountedAllocator & = default;
+
+    template < class Y >
+    constexpr AccountedAllocator( AccountedAllocator< Y, Category > const & ) noexcept {}
+
+    auto allocate( std::size_t count ) -> T *
+      {
+        auto const result = std::allocator< T >{}.allocate( count );
+        MemoryAccounting::instance().allocate( Category, count * sizeof( T ) );
+        return result;
+      }
+
+    void deallocate( T *x, std::size_t count ) noexcept
+      {
+        MemoryAccounting::instance().deallocate( Category, count * sizeof( T ) );
+        std::allocator< T >{}.deallocate( x, count );
+      }
+
+    template < class Y >
+    constexpr auto operator ==( AccountedAllocator< Y, Category > const & ) const noexcept -> bool
+      { return true; }
+
+    template < class Y >
+    constexpr auto operator !=( AccountedAllocator< Y, Category > const & ) const noexcept -> bool
+      { return false; }
+  };
+
+// A plain std::vector unless TP_MEMORY_ACCOUNTING is defined
+#if defined( TP_MEMORY_ACCOUNTING )
+template < class T, MemoryCategories Category = MemoryCategories::Scratch >
+using AccountedVector = std::vector< T, AccountedAllocator< T, Category > >;
+#else
+template < class T, MemoryCategories Category = MemoryCategories::Scratch >
+using AccountedVector = std::vector< T >;
+#endif // defined( TP_MEMORY_ACCOUNTING )
+
+
 
 class RecordBase
   {
@@ -399,15 +724,93 @@ class ServiceBase
       {
         if ( !owned )
           { service.retainProc( x ); }
+#if defined( TP_MEMORY_ACCOUNTING )
+        if ( x )
+          { MemoryAccounting::instance().hostObjectCreated( owned ); }
+        auto const release = service.releaseProc;
+        object_.reset( x, [ release ]( Object y )
+          {
+            if ( y )
+              { MemoryAccounting::instance().hostObjectReleased(); }
+            release( y );
+          } );
+#else
         object_.reset( x, service.releaseProc );
+#endif // defined( TP_MEMORY_ACCOUNTING )
       }
 
+    constexpr void rebind( std::weak_ptr< Server const > const &server ) noexcept
+      { server_ = server; }
+
   private:
     std::weak_ptr< Server const > server_;
     std::shared_ptr< std::remove_pointer_t< Object_ > > object_;
   };
 
 
+template < class CharT >
+class BasicStringView
+  {
+  public:
+    using value_type = CharT;
+    using size_type = std::size_t;
+    using const_iterator = CharT const *;
+
+    ~BasicStringView() = default;
+    constexpr BasicStringView() noexcept : data_{}, size_{} {}
+    BasicStringView( BasicStringView const & ) = default;
+    BasicStringView( BasicStringView && ) = default;
+    auto operator =( BasicStringView const & ) -> BasicStringView & = default;
+    auto operator =( BasicStringView && ) -> BasicStringView & = default;
+
+    constexpr BasicStringView( CharT const *data, size_type size ) noexcept
+      : data_{ data }, size_{ size } {}
+
+    BasicStringView( std::basic_string< CharT > const &x ) noexcept
+      : data_{ x.data() }, size_{ x.size() } {}
+
+    constexpr auto data() const noexcept -> CharT const * { return data_; }
+    constexpr auto size() const noexcept -> size_type { return size_; }
+    constexpr auto length() const noexcept -> size_type { return size_; }
+    constexpr auto empty() const noexcept -> bool { return !size_; }
+    constexpr auto begin() const noexcept -> const_iterator { return data_; }
+    constexpr auto end() const noexcept -> const_iterator { return data_ + size_; }
+
+    constexpr auto operator []( size_type i ) const noexcept -> CharT const &
+      { return data_[ i ]; }
+
+    auto str() const -> std::basic_string< CharT >
+      { return std::basic_string< CharT >{ data_, size_ }; }
+
+    operator std::basic_string< CharT >() const
+      { return str(); }
+
+    auto compare( BasicStringView const &x ) const noexcept -> int
+      {
+        auto const n = size_ < x.size_ ? size_ : x.size_;
+        if ( auto const q = n ? std::char_traits< CharT >::compare( data_, x.data_, n ) : 0 )
+          { return q; }
+        return size_ < x.size_ ? -1 : x.size_ < size_ ? 1 : 0;
+      }
+
+    friend auto operator ==( BasicStringView const &a, BasicStringView const &b ) noexcept -> bool
+      { return a.size_ == b.size_ && !a.compare( b ); }
+
+    friend auto operator !=( BasicStringView const &a, BasicStringView const &b ) noexcept -> bool
+      { return !( a == b ); }
+
+    friend auto operator <( BasicStringView const &a, BasicStringView const &b ) noexcept -> bool
+      { return a.compare( b ) < 0; }
+
+  private:
+    CharT const *data_;
+    size_type size_;
+  };
+
+using StringView = BasicStringView< char >;
+using U16StringView = BasicStringView< char16_t >;
+
+
 class String : public ServiceBase< StringObject >
   {
   public:
@@ -422,9 +825,12 @@ class String : public ServiceBase< StringObject >
             UnicodeString,
           };
 
+        // Strings up to this many bytes are kept in place instead of on the heap
+        constexpr static std::size_t kInlineBytes = 32;
+
         ~Data() { unset(); }
 
-        Data() : type_{ Types::AsciiString } { new ( &string8_ ) std::string{}; }
+        Data() : type_{ Types::AsciiString }, storage_{ Storages::Inline }, size_{}, inline8_{} {}
         Data( Data const &x ) { set( x ); }
         Data( Data &&x ) noexcept { set( std::move( x ) ); }
 
@@ -443,28 +849,55 @@ class String : public ServiceBase< StringObject >
           }
 
         constexpr Data( StringId x ) noexcept
-          : type_{ Types::StringId }, stringId_{ x } {}
+          : type_{ Types::StringId }, storage_{ Storages::Inline }, size_{}, stringId_{ x } {}
 
-        Data( std::string const &x, bool locale )
+        Data( StringView x, bool locale )
           : type_{ locale ? Types::LocaleCodeString : Types::AsciiString }
-          , stringId_{}
-          { new ( &string8_ ) std::string{ x }; }
+          { store( x ); }
+
+        Data( U16StringView x )
+          : type_{ Types::UnicodeString }
+          { store( x ); }
+
+        Data( char const *x, bool locale )
+          : Data{ StringView{ x, std::char_traits< char >::length( x ) }, locale } {}
+
+        Data( char16_t const *x )
+          : Data{ U16StringView{ x, std::char_traits< char16_t >::length( x ) } } {}
+
+        Data( std::string const &x, bool locale )
+          : Data{ StringView{ x }, locale } {}
 
         Data( std::string &&x, bool locale ) noexcept
           : type_{ locale ? Types::LocaleCodeString : Types::AsciiString }
-          , stringId_{}
+          , storage_{ Storages::Owned }
+          , size_{}
           { new ( &string8_ ) std::string{ std::move( x ) }; }
 
         Data( std::u16string const &x )
-          : type_{ Types::UnicodeString }
-          , stringId_{}
-          { new ( &string16_ ) std::u16string{ x }; }
+          : Data{ U16StringView{ x } } {}
 
         Data( std::u16string &&x ) noexcept
           : type_{ Types::UnicodeString }
-          , stringId_{}
+          , storage_{ Storages::Owned }
+          , size_{}
           { new ( &string16_ ) std::u16string{ std::move( x ) }; }
 
+        // References a string literal in place; x must outlive every copy of the result
+        template < std::size_t N >
+        static auto literal( char const ( &x )[ N ], bool locale ) noexcept -> Data
+          {
+            TP_ASSERT( x[ N - 1 ] == '\0' );
+            return Data{ StringView{ x, N - 1 }, locale, Borrow{} };
+          }
+
+        template < std::size_t N >
+        static auto literal( char16_t const ( &x )[ N ] ) noexcept -> Data
+          {
+            TP_ASSERT( x[ N - 1 ] == u'\0' );
+            return Data{ U16StringView{ x, N - 1 }, Borrow{} };
+          }
+
         auto type() const noexcept -> Types { return type_; }
 
         auto stringId() const noexcept -> StringId
@@ -473,28 +906,158 @@ class String : public ServiceBase< StringObject >
             return stringId_;
           }
 
-        auto asciiString() const noexcept -> std::string const &
+        // Copies; the ...View() accessors below read the storage in place
+        auto asciiString() const -> std::string
+          {
+            TP_ASSERT( type_ == Types::AsciiString );
+            return string8().str();
+          }
+
+        auto localCodeString() const -> std::string
+          {
+            TP_ASSERT( type_ == Types::LocaleCodeString );
+            return string8().str();
+          }
+
+        auto unicodeString() const -> std::u16string
+          {
+            TP_ASSERT( type_ == Types::UnicodeString );
+            return string16().str();
+          }
+
+        auto asciiStringView() const noexcept -> StringView
           {
             TP_ASSERT( type_ == Types::AsciiString );
-            return string8_;
+            return string8();
           }
 
-        auto localCodeString() const noexcept -> std::string const &
+        auto localCodeStringView() const noexcept -> StringView
           {
             TP_ASSERT( type_ == Types::LocaleCodeString );
-            return string8_;
+            return string8();
           }
 
-        auto unicodeString() const noexcept -> std::u16string const &
+        auto unicodeStringView() const noexcept -> U16StringView
           {
             TP_ASSERT( type_ == Types::UnicodeString );
-            return string16_;
+            return string16();
+          }
+
+        friend auto operator ==( Data const &a, Data const &b ) noexcept -> bool
+          {
+            if ( a.type_ != b.type_ )
+              { return false; }
+            switch ( a.type_ )
+              {
+                case Types::StringId:
+                    return a.stringId_ == b.stringId_;
+                case Types::AsciiString:
+                case Types::LocaleCodeString:
+                    return a.string8() == b.string8();
+                case Types::UnicodeString:
+                    return a.string16() == b.string16();
+              }
+            return false;
+          }
+
+        friend auto operator <( Data const &a, Data const &b ) noexcept -> bool
+          {
+            if ( a.type_ != b.type_ )
+              { return a.type_ < b.type_; }
+            switch ( a.type_ )
+              {
+                case Types::StringId:
+                    return a.stringId_ < b.stringId_;
+                case Types::AsciiString:
+                case Types::LocaleCodeString:
+                    return a.string8() < b.string8();
+                case Types::UnicodeString:
+                    return a.string16() < b.string16();
+              }
+            return false;
           }
 
       private:
+        enum class Storages : std::uint8_t
+          {
+            Borrowed,
+            Inline,
+            Owned,
+          };
+
+        struct Borrow {};
+
+        Data( StringView x, bool locale, Borrow ) noexcept
+          : type_{ locale ? Types::LocaleCodeString : Types::AsciiString }, storage_{ Storages::Borrowed }, size_{}, borrowed8_{ x } {}
+
+        Data( U16StringView x, Borrow ) noexcept
+          : type_{ Types::UnicodeString }, storage_{ Storages::Borrowed }, size_{}, borrowed16_{ x } {}
+
+        void store( StringView x )
+          {
+            size_ = {};
+            if ( x.size() <= sizeof( inline8_ ) )
+              {
+                storage_ = Storages::Inline;
+                size_ = static_cast< std::uint8_t >( x.size() );
+                std::char_traits< char >::copy( inline8_, x.data(), x.size() );
+              }
+            else
+              {
+                storage_ = Storages::Owned;
+                new ( &string8_ ) std::string{ x.data(), x.size() };
+              }
+          }
+
+        void store( U16StringView x )
+          {
+            size_ = {};
+            if ( x.size() <= sizeof( inline16_ ) / sizeof( char16_t ) )
+              {
+                storage_ = Storages::Inline;
+                size_ = static_cast< std::uint8_t >( x.size() );
+                std::char_traits< char16_t >::copy( inline16_, x.data(), x.size() );
+              }
+            else
+              {
+                storage_ = Storages::Owned;
+                new ( &string16_ ) std::u16string{ x.data(), x.size() };
+              }
+          }
+
+        auto string8() const noexcept -> StringView
+          {
+            switch ( storage_ )
+              {
+                case Storages::Borrowed:
+                    return borrowed8_;
+                case Storages::Inline:
+                    return StringView{ inline8_, size_ };
+                case Storages::Owned:
+                    break;
+              }
+            return StringView{ string8_ };
+          }
+
+        auto string16() const noexcept -> U16StringView
+          {
+            switch ( storage_ )
+              {
+                case Storages::Borrowed:
+                    return borrowed16_;
+                case Storages::Inline:
+                    return U16StringView{ inline16_, size_ };
+                case Storages::Owned:
+                    break;
+              }
+            return U16StringView{ string16_ };
+          }
+
         void set( Data const &x )
           {
             type_ = x.type_;
+            storage_ = x.storage_;
+            size_ = x.size_;
             switch ( type_ )
               {
                 case Types::StringId:
@@ -502,17 +1065,34 @@ class String : public ServiceBase< StringObject >
                     break;
                 case Types::AsciiString:
                 case Types::LocaleCodeString:
-                    new ( &string8_ ) std::string{ x.string8_ };
+                    if ( storage_ == Storages::Owned )
+                      { new ( &string8_ ) std::string{ x.string8_ }; }
+                    else if ( storage_ == Storages::Borrowed )
+                      { borrowed8_ = x.borrowed8_; }
+                    else
+                      { std::char_traits< char >::copy( inline8_, x.inline8_, size_ ); }
                     break;
                 case Types::UnicodeString:
-                    new ( &string16_ ) std::u16string{ x.string16_ };
+                    if ( storage_ == Storages::Owned )
+                      { new ( &string16_ ) std::u16string{ x.string16_ }; }
+                    else if ( storage_ == Storages::Borrowed )
+                      { borrowed16_ = x.borrowed16_; }
+                    else
+                      { std::char_traits< char16_t >::copy( inline16_, x.inline16_, size_ ); }
                     break;
               }
           }
 
         void set( Data &&x ) noexcept
           {
+            if ( x.storage_ != Storages::Owned )
+              {
+                set( static_cast< Data const & >( x ) );
+                return;
+              }
             type_ = x.type_;
+            storage_ = x.storage_;
+            size_ = x.size_;
             switch ( type_ )
               {
                 case Types::StringId:
@@ -530,6 +1110,8 @@ class String : public ServiceBase< StringObject >
 
         void unset() noexcept
           {
+            if ( storage_ != Storages::Owned )
+              { return; }
             switch ( type_ )
               {
                 case Types::StringId:
@@ -545,11 +1127,17 @@ class String : public ServiceBase< StringObject >
           }
 
         Types type_;
+        Storages storage_;
+        std::uint8_t size_;
         union
           {
             StringId stringId_;
             std::string string8_;
             std::u16string string16_;
+            StringView borrowed8_;
+            U16StringView borrowed16_;
+            char inline8_[ kInlineBytes ];
+            char16_t inline16_[ kInlineBytes / sizeof( char16_t ) ];
           };
       };
 
@@ -572,13 +1160,13 @@ class String : public ServiceBase< StringObject >
         return nullptr;
       }
 
-    auto makeWithAsciiString( std::string const &str ) -> APIResult< void >
+    auto makeWithAsciiString( StringView str ) -> APIResult< void >
       {
         APIResult< void > result{};
         if ( auto const pservice = service() )
           {
             Object x{};
-            auto const a0 = str.c_str();
+            auto const a0 = str.data();
             auto const a1 = static_cast< Int >( str.length() );
             auto const q = toAPIResults( pservice->createWithAsciiStringProc( &x, a0, a1 ) );
             result.reset( q );
@@ -588,13 +1176,13 @@ class String : public ServiceBase< StringObject >
         return result;
       }
 
-    auto makeWithUnicodeString( std::u16string const &str ) -> APIResult< void >
+    auto makeWithUnicodeString( U16StringView str ) -> APIResult< void >
       {
         APIResult< void > result{};
         if ( auto const pservice = service() )
           {
             Object x{};
-            auto const a0 = reinterpret_cast< UniChar const * >( str.c_str() );
+            auto const a0 = reinterpret_cast< UniChar const * >( str.data() );
             auto const a1 = static_cast< Int >( str.length() );
             auto const q = toAPIResults( pservice->createWithUnicodeStringProc( &x, a0, a1 ) );
             result.reset( q );
@@ -604,13 +1192,13 @@ class String : public ServiceBase< StringObject >
         return result;
       }
 
-    auto makeWithLocalCodeString( std::string const &str ) -> APIResult< void >
+    auto makeWithLocalCodeString( StringView str ) -> APIResult< void >
       {
         APIResult< void > result{};
         if ( auto const pservice = service() )
           {
             Object x{};
-            auto const a0 = str.c_str();
+            auto const a0 = str.data();
             auto const a1 = static_cast< Int >( str.length() );
             auto const q = toAPIResults( pservice->createWithLocalCodeStringProc( &x, a0, a1 ) );
             result.reset( q ); 
@@ -636,9 +1224,9 @@ class String : public ServiceBase< StringObject >
         return result;
       }
 
-    auto getUnicodeString() const -> APIResult< std::u16string >
+    auto getUnicodeStringView() const noexcept -> APIResult< U16StringView >
       {
-        APIResult< std::u16string > result{};
+        APIResult< U16StringView > result{};
         if ( auto const pservice = service() )
           {
             UniChar const *x0{};
@@ -647,18 +1235,15 @@ class String : public ServiceBase< StringObject >
               {
                 Int x1{};
                 q = toAPIResults( pservice->getUnicodeLengthProc( &x1, *this ) );
-                if ( isSuccess( q ) )
-                  { result.reset( q, std::u16string{ reinterpret_cast< char16_t const * >( x0 ), static_cast< size_t >( x1 ) }); }
-                else
-                  { result.reset( q ); }
+                result.reset( q, U16StringView{ reinterpret_cast< char16_t const * >( x0 ), static_cast< size_t >( x1 ) } );
               }
           }
         return result;
       }
 
-    auto getLocalCodeString() const -> APIResult< std::string >
+    auto getLocalCodeStringView() const noexcept -> APIResult< StringView >
       {
-        APIResult< std::string > result{};
+        APIResult< StringView > result{};
         if( auto const pservice = service() )
           {
             Char const *x0{};
@@ -667,14 +1252,23 @@ class String : public ServiceBase< StringObject >
               {
                 Int x1{};
                 q = toAPIResults( pservice->getLocalCodeLengthProc( &x1, *this ) );
-                if ( isSuccess( q ) )
-                  { result.reset( q, std::string{ x0, static_cast< size_t >( x1 ) } ); }
-                else
-                  { result.reset( q ); }
+                result.reset( q, StringView{ x0, static_cast< size_t >( x1 ) } );
               }
           }
         return result;
       }
+
+    auto getUnicodeString() const -> APIResult< std::u16string >
+      {
+        auto const x = getUnicodeStringView();
+        return APIResult< std::u16string >{ x.state(), x ? x->str() : std::u16string{} };
+      }
+
+    auto getLocalCodeString() const -> APIResult< std::string >
+      {
+        auto const x = getLocalCodeStringView();
+        return APIResult< std::string >{ x.state(), x ? x->str() : std::string{} };
+      }
   };
 
 inline auto makeStringWithObject( std::weak_ptr< Server const > const &server, StringObject object, bool owned ) noexcept -> String
@@ -685,21 +1279,21 @@ inline auto makeStringWithObject( std::weak_ptr< Server const > const &server, S
     return result;
   }
 
-inline auto makeStringWithAsciiString( std::weak_ptr< Server const > const &server, std::string const &x ) -> String
+inline auto makeStringWithAsciiString( std::weak_ptr< Server const > const &server, StringView x ) -> String
   {
     String result{ server };
     result.makeWithAsciiString( x );
     return result;
   }
 
-inline auto makeStringWithUnicodeString( std::weak_ptr< Server const > const &server, std::u16string const &x ) -> String
+inline auto makeStringWithUnicodeString( std::weak_ptr< Server const > const &server, U16StringView x ) -> String
   {
     String result{ server };
     result.makeWithUnicodeString( x );
     return result;
   }
 
-inline auto makeStringWithLocalCodeString( std::weak_ptr< Server const > const &server, std::string const &x ) -> String
+inline auto makeStringWithLocalCodeString( std::weak_ptr< Server const > const &server, StringView x ) -> String
   {
     String result{ server };
     result.makeWithLocalCodeString( x );
@@ -722,19 +1316,90 @@ inline auto makeStringWithData( std::weak_ptr< Server const > const &server, Str
             result.makeWithStringId( x.stringId() );
             break;
         case String::Data::Types::AsciiString:
-            result.makeWithAsciiString( x.asciiString() );
+            result.makeWithAsciiString( x.asciiStringView() );
             break;
         case String::Data::Types::LocaleCodeString:
-            result.makeWithLocalCodeString( x.localCodeString() );
+            result.makeWithLocalCodeString( x.localCodeStringView() );
             break;
         case String::Data::Types::UnicodeString:
-            result.makeWithUnicodeString( x.unicodeString() );
+            result.makeWithUnicodeString( x.unicodeStringView() );
             break;
       }
     return result;
   }
 
 
+class StringCache
+  {
+  public:
+    ~StringCache() = default;
+    StringCache() = default;
+    StringCache( StringCache const & ) = delete;
+    StringCache( StringCache && ) = default;
+    auto operator =( StringCache const & ) -> StringCache & = delete;
+    auto operator =( StringCache && ) -> StringCache & = default;
+
+    auto getString( std::weak_ptr< Server const > const &server, String::Data const &x ) -> String
+      {
+        auto it = strings_.find( x );
+        if ( it == strings_.end() )
+          {
+            auto str = makeStringWithData( server, x );
+            if ( !str )
+              { return str; }
+            it = strings_.emplace( x, std::move( str ) ).first;
+            MemoryAccounting::instance().allocate( MemoryCategories::Caches, kStringEntryBytes );
+          }
+        auto result = it->second;
+        result.rebind( server );
+        return result;
+      }
+
+    auto getAccessKey( std::weak_ptr< Server const > const &server, String::Data const &x ) -> APIResult< Char >
+      {
+        auto const it = accessKeys_.find( x );
+        if ( it != accessKeys_.end() )
+          { return it->second; }
+        if ( auto const str = getString( server, x ).getLocalCodeStringView() )
+          {
+            if ( !str->empty() )
+              {
+                MemoryAccounting::instance().allocate( MemoryCategories::Caches, kAccessKeyEntryBytes );
+                return accessKeys_.emplace( x, ( *str )[ 0 ] ).first->second;
+              }
+          }
+        return APIResults::Failed;
+      }
+
+    auto getCaption( std::weak_ptr< Server const > const &server, String::Data const &name, String::Data const &accessKey ) -> APIResult< std::pair< String, Char > >
+      {
+        if ( auto const strName = getString( server, name ) )
+          {
+            if ( auto const chAccessKey = getAccessKey( server, accessKey ) )
+              { return std::make_pair( strName, *chAccessKey ); }
+          }
+        return APIResults::Failed;
+      }
+
+    auto size() const noexcept -> std::size_t
+      { return strings_.size(); }
+
+    void clear() noexcept
+      {
+        MemoryAccounting::instance().deallocate( MemoryCategories::Caches, strings_.size() * kStringEntryBytes + accessKeys_.size() * kAccessKeyEntryBytes );
+        strings_.clear();
+        accessKeys_.clear();
+      }
+
+  private:
+    constexpr static std::size_t kStringEntryBytes = sizeof( std::pair< String::Data const, String > );
+    constexpr static std::size_t kAccessKeyEntryBytes = sizeof( std::pair< String::Data const, Char > );
+
+    std::map< String::Data, String > strings_;
+    std::map< String::Data, Char > accessKeys_;
+  };
+
+
 class Bitmap : public ServiceBase< BitmapObject >
   {
   public:
@@ -1253,31 +1918,177 @@ class Offscreen : public ServiceBase< OffscreenObject >
         return result;
       }
 
-    auto getBitmapNormalAlphaChannelIndex( BitmapObject bitmap ) const noexcept -> APIResult< Int >
+    auto getBitmapNormalAlphaChannelIndex( BitmapObject bitmap ) const noexcept -> APIResult< Int >
+      {
+        APIResult< Int > result{};
+        if ( auto const pservice = service2() )
+          {
+            Int x{};
+            auto const q = toAPIResults( pservice->getBitmapNormalAlphaChannelIndexProc( &x, *this ) );
+            result.reset( q, x );
+          }
+        return result;
+      }
+  };
+
+static_assert( std::is_trivially_copyable< APIResult< Offscreen::MutableBlock > >::value, "APIResult< Offscreen::MutableBlock > must be trivially copyable" );
+
+inline auto makeOffscreenWithObject( std::weak_ptr< Server const > const &server, OffscreenObject object, bool owned ) -> Offscreen
+  {
+    Offscreen result{ server };
+    if ( auto const pservice = result.service() )
+      { result.reset( *pservice, object, owned ); }
+    return result;
+  }
+
+inline auto makePlaneOffscreen( std::weak_ptr< Server const > const &server, Int width, Int height, Int depth ) -> Offscreen
+  {
+    Offscreen result{ server };
+    result.makePlane( width, height, depth );
+    return result;
+  }
+
+
+class BlockGrid
+  {
+  public:
+    ~BlockGrid() = default;
+    BlockGrid() = default;
+    BlockGrid( BlockGrid const & ) = default;
+    BlockGrid( BlockGrid && ) = default;
+    auto operator =( BlockGrid const & ) -> BlockGrid & = default;
+    auto operator =( BlockGrid && ) -> BlockGrid & = default;
+
+    constexpr BlockGrid( Rect const &offscreenRect, Int tileWidth, Int tileHeight, Rect const &bounds ) noexcept
+      : origin_{ offscreenRect.left, offscreenRect.top }
+      , tileWidth_{ tileWidth }
+      , tileHeight_{ tileHeight }
+      , bounds_{ intersect( offscreenRect, bounds ) }
+      , column_{ isEmpty( bounds_ ) || tileWidth <= 0 ? 0 : floorDiv( bounds_.left - origin_.x, tileWidth ) }
+      , row_{ isEmpty( bounds_ ) || tileHeight <= 0 ? 0 : floorDiv( bounds_.top - origin_.y, tileHeight ) }
+      , columns_{ isEmpty( bounds_ ) || tileWidth <= 0 ? 0 : ceilDiv( bounds_.right - origin_.x, tileWidth ) - column_ }
+      , rows_{ isEmpty( bounds_ ) || tileHeight <= 0 ? 0 : ceilDiv( bounds_.bottom - origin_.y, tileHeight ) - row_ }
+      {}
+
+    auto make( Offscreen const &offscreen, Rect const &bounds ) -> APIResult< void >
+      {
+        auto const rect = offscreen.getRect();
+        auto const tileWidth = offscreen.getTileWidth();
+        auto const tileHeight = offscreen.getTileHeight();
+        if ( !rect || !tileWidth || !tileHeight )
+          { return APIResults::Failed; }
+        *this = BlockGrid{ *rect, *tileWidth, *tileHeight, bounds };
+
+        // Every build checks the block count and the two corner blocks against the host; debug builds check every block
+        if ( !isConsistentAtCorners( offscreen ) )
+          {
+            *this = BlockGrid{};
+            return APIResults::Failed;
+          }
+        TP_ASSERT( isConsistentWith( offscreen ) );
+        return APIResults::Success;
+      }
+
+    constexpr explicit operator bool() const noexcept
+      { return count() > 0; }
+
+    constexpr auto bounds() const noexcept -> Rect const &
+      { return bounds_; }
+
+    constexpr auto columns() const noexcept -> Int
+      { return columns_; }
+
+    constexpr auto rows() const noexcept -> Int
+      { return rows_; }
+
+    constexpr auto count() const noexcept -> Int
+      { return columns_ * rows_; }
+
+    constexpr auto column( Int index ) const noexcept -> Int
+      { return index % columns_; }
+
+    constexpr auto row( Int index ) const noexcept -> Int
+      { return index / columns_; }
+
+    constexpr auto index( Int column, Int row ) const noexcept -> Int
+      { return row * columns_ + column; }
+
+    constexpr auto contains( Int column, Int row ) const noexcept -> bool
+      { return 0 <= column && column < columns_ && 0 <= row && row < rows_; }
+
+    constexpr auto indexAt( Point const &pos ) const noexcept -> Int
+      {
+        if ( pos.x < bounds_.left || bounds_.right <= pos.x || pos.y < bounds_.top || bounds_.bottom <= pos.y )
+          { return -1; }
+        return index( floorDiv( pos.x - origin_.x, tileWidth_ ) - column_, floorDiv( pos.y - origin_.y, tileHeight_ ) - row_ );
+      }
+
+    constexpr auto neighbor( Int index, Int dx, Int dy ) const noexcept -> Int
+      {
+        auto const c = column( index ) + dx;
+        auto const r = row( index ) + dy;
+        return contains( c, r ) ? this->index( c, r ) : -1;
+      }
+
+    constexpr auto rect( Int column, Int row ) const noexcept -> Rect
+      {
+        auto const left = origin_.x + ( column_ + column ) * tileWidth_;
+        auto const top = origin_.y + ( row_ + row ) * tileHeight_;
+        return intersect( Rect{ left, top, left + tileWidth_, top + tileHeight_ }, bounds_ );
+      }
+
+    constexpr auto rect( Int index ) const noexcept -> Rect
+      { return rect( column( index ), row( index ) ); }
+
+    auto isConsistentWith( Offscreen const &offscreen ) const noexcept -> bool
+      {
+        auto const n = offscreen.getBlockRectCount( bounds_ );
+        if ( !n || *n != count() )
+          { return false; }
+        for ( auto i = decltype( count() ){}; i < count(); ++i )
+          {
+            if ( !isConsistentAt( offscreen, i ) )
+              { return false; }
+          }
+        return true;
+      }
+
+  private:
+    auto isConsistentAtCorners( Offscreen const &offscreen ) const noexcept -> bool
+      {
+        auto const n = offscreen.getBlockRectCount( bounds_ );
+        if ( !n || *n != count() )
+          { return false; }
+        return count() == 0 || ( isConsistentAt( offscreen, 0 ) && isConsistentAt( offscreen, count() - 1 ) );
+      }
+
+    auto isConsistentAt( Offscreen const &offscreen, Int index ) const noexcept -> bool
       {
-        APIResult< Int > result{};
-        if ( auto const pservice = service2() )
-          {
-            Int x{};
-            auto const q = toAPIResults( pservice->getBitmapNormalAlphaChannelIndexProc( &x, *this ) );
-            result.reset( q, x );
-          }
-        return result;
+        auto const x = offscreen.getBlockRect( index, bounds_ );
+        auto const y = rect( index );
+        return x && x->left == y.left && x->top == y.top && x->right == y.right && x->bottom == y.bottom;
       }
-  };
 
-inline auto makeOffscreenWithObject( std::weak_ptr< Server const > const &server, OffscreenObject object, bool owned ) -> Offscreen
-  {
-    Offscreen result{ server };
-    if ( auto const pservice = result.service() )
-      { result.reset( *pservice, object, owned ); }
-    return result;
-  }
+    constexpr static auto floorDiv( Int a, Int b ) noexcept -> Int
+      { return a / b - ( a % b != 0 && ( a < 0 ) != ( b < 0 ) ); }
 
-inline auto makePlaneOffscreen( std::weak_ptr< Server const > const &server, Int width, Int height, Int depth ) -> Offscreen
+    constexpr static auto ceilDiv( Int a, Int b ) noexcept -> Int
+      { return -floorDiv( -a, b ); }
+
+    Point origin_{};
+    Int tileWidth_{};
+    Int tileHeight_{};
+    Rect bounds_{};
+    Int column_{};
+    Int row_{};
+    Int columns_{};
+    Int rows_{};
+  };
+
+inline auto makeBlockGrid( Offscreen const &offscreen, Rect const &bounds ) -> BlockGrid
   {
-    Offscreen result{ server };
-    result.makePlane( width, height, depth );
+    BlockGrid result{};
+    result.make( offscreen, bounds );
     return result;
   }
 
@@ -1987,6 +2798,200 @@ inline auto makeProperty( std::weak_ptr< Server const > const &server ) -> Prope
   }
 
 
+template < class Params >
+struct IntegerPropertyItem
+  {
+    using Parameters = Params;
+
+    Property::ItemKey key;
+    StringId caption;
+    StringId accessKey;
+    Integer minValue;
+    Integer maxValue;
+    Integer defaultValue;
+    bool storeValue;
+    Integer Params::*member;
+
+    template < class MakeCaption >
+    auto add( Property const &prop, MakeCaption const &makeCaption ) const -> bool
+      {
+        if ( auto const pair = makeCaption( caption, accessKey ) )
+          {
+            return prop.addItem( key, Property::ValueTypes::Integer, Property::ValueKinds::Default, Property::InputKinds::Default, pair->first, pair->second )
+                && prop.setIntegerMinValue( key, minValue )
+                && prop.setIntegerMaxValue( key, maxValue )
+                && prop.setIntegerDefaultValue( key, defaultValue )
+                && prop.setItemStoreValue( key, storeValue );
+          }
+        return false;
+      }
+
+    void reset( Params &params ) const noexcept
+      { params.*member = defaultValue; }
+
+    auto update( Property const &prop, Params &params ) const noexcept -> Property::CallBackResults
+      {
+        if ( auto const x = prop.getIntegerValue( key ) )
+          {
+            if ( params.*member != *x )
+              {
+                params.*member = *x;
+                return Property::CallBackResults::Modify;
+              }
+          }
+        return Property::CallBackResults::NoModify;
+      }
+  };
+
+template < class Params >
+struct DecimalPropertyItem
+  {
+    using Parameters = Params;
+
+    Property::ItemKey key;
+    StringId caption;
+    StringId accessKey;
+    Decimal minValue;
+    Decimal maxValue;
+    Decimal defaultValue;
+    bool storeValue;
+    Decimal Params::*member;
+
+    template < class MakeCaption >
+    auto add( Property const &prop, MakeCaption const &makeCaption ) const -> bool
+      {
+        if ( auto const pair = makeCaption( caption, accessKey ) )
+          {
+            return prop.addItem( key, Property::ValueTypes::Decimal, Property::ValueKinds::Default, Property::InputKinds::Default, pair->first, pair->second )
+                && prop.setDecimalMinValue( key, minValue )
+                && prop.setDecimalMaxValue( key, maxValue )
+                && prop.setDecimalDefaultValue( key, defaultValue )
+                && prop.setItemStoreValue( key, storeValue );
+          }
+        return false;
+      }
+
+    void reset( Params &params ) const noexcept
+      { params.*member = defaultValue; }
+
+    auto update( Property const &prop, Params &params ) const noexcept -> Property::CallBackResults
+      {
+        if ( auto const x = prop.getDecimalValue( key ) )
+          {
+            if ( params.*member != *x )
+              {
+                params.*member = *x;
+                return Property::CallBackResults::Modify;
+              }
+          }
+        return Property::CallBackResults::NoModify;
+      }
+  };
+
+template < class Params >
+struct BooleanPropertyItem
+  {
+    using Parameters = Params;
+
+    Property::ItemKey key;
+    StringId caption;
+    StringId accessKey;
+    bool defaultValue;
+    bool storeValue;
+    bool Params::*member;
+
+    template < class MakeCaption >
+    auto add( Property const &prop, MakeCaption const &makeCaption ) const -> bool
+      {
+        if ( auto const pair = makeCaption( caption, accessKey ) )
+          {
+            return prop.addItem( key, Property::ValueTypes::Boolean, Property::ValueKinds::Default, Property::InputKinds::Default, pair->first, pair->second )
+                && prop.setBooleanDefaultValue( key, defaultValue )
+                && prop.setItemStoreValue( key, storeValue );
+          }
+        return false;
+      }
+
+    void reset( Params &params ) const noexcept
+      { params.*member = defaultValue; }
+
+    auto update( Property const &prop, Params &params ) const noexcept -> Property::CallBackResults
+      {
+        if ( auto const x = prop.getBooleanValue( key ) )
+          {
+            if ( params.*member != *x )
+              {
+                params.*member = *x;
+                return Property::CallBackResults::Modify;
+              }
+          }
+        return Property::CallBackResults::NoModify;
+      }
+  };
+
+template < class Params, class... Items >
+class PropertySchema
+  {
+  public:
+    using Parameters = Params;
+
+    constexpr explicit PropertySchema( Items const &... items )
+      : items_{ items... } {}
+
+    auto defaults() const noexcept -> Params
+      {
+        Params result{};
+        forEach( [ & ]( auto const &item ) { item.reset( result ); } );
+        return result;
+      }
+
+    template < class MakeCaption >
+    auto add( Property const &prop, MakeCaption const &makeCaption ) const -> bool
+      {
+        auto result = true;
+        forEach( [ & ]( auto const &item ) { result = result && item.add( prop, makeCaption ); } );
+        return result;
+      }
+
+    auto load( Property const &prop, Params &params ) const noexcept -> Property::CallBackResults
+      {
+        auto result = Property::CallBackResults::NoModify;
+        forEach( [ & ]( auto const &item )
+          {
+            if ( item.update( prop, params ) == Property::CallBackResults::Modify )
+              { result = Property::CallBackResults::Modify; }
+          } );
+        return result;
+      }
+
+    auto update( Property const &prop, Property::ItemKey key, Params &params ) const noexcept -> Property::CallBackResults
+      {
+        auto result = Property::CallBackResults::NoModify;
+        forEach( [ & ]( auto const &item )
+          {
+            if ( item.key == key )
+              { result = item.update( prop, params ); }
+          } );
+        return result;
+      }
+
+  private:
+    template < class F >
+    void forEach( F &&f ) const
+      { forEach( f, std::index_sequence_for< Items... >{} ); }
+
+    template < class F, std::size_t... I >
+    void forEach( F &f, std::index_sequence< I... > ) const
+      { (void)std::initializer_list< int >{ 0, ( f( std::get< I >( items_ ) ), 0 )... }; }
+
+    std::tuple< Items... > items_;
+  };
+
+template < class Params, class... Items >
+constexpr auto makePropertySchema( Items const &... items ) -> PropertySchema< Params, Items... >
+  { return PropertySchema< Params, Items... >{ items... }; }
+
+
 class ModuleInitializer : public RecordBase
   {
   public:
@@ -2456,6 +3461,554 @@ class FilterRunner : public RecordBase
 inline auto makeFilterRunner( std::weak_ptr< Server const > const &server ) noexcept -> FilterRunner
   { return FilterRunner{ server }; }
 
+
+class FilterRunContext
+  {
+  public:
+    ~FilterRunContext() = default;
+    FilterRunContext() = default;
+    FilterRunContext( FilterRunContext const & ) = default;
+    FilterRunContext( FilterRunContext && ) = default;
+    auto operator =( FilterRunContext const & ) -> FilterRunContext & = default;
+    auto operator =( FilterRunContext && ) -> FilterRunContext & = default;
+
+    explicit operator bool() const noexcept
+      { return static_cast< bool >( destinationOffscreen ); }
+
+    auto make( std::weak_ptr< Server const > const &server ) -> APIResult< void >
+      {
+        *this = FilterRunContext{};
+
+        auto const fr = makeFilterRunner( server );
+
+        auto const source = fr.getSourceOffscreen();
+        auto const destination = fr.getDestinationOffscreen();
+        auto const rect = fr.getSelectAreaRect();
+        auto const hasSelectArea = fr.hasSelectAreaOffscreen();
+        if ( !source || !destination || !rect || !hasSelectArea )
+          { return APIResults::Failed; }
+
+        auto src = makeOffscreenWithObject( server, *source, false );
+        auto dst = makeOffscreenWithObject( server, *destination, false );
+
+        auto const order = dst.getChannelOrder();
+        auto const width = dst.getTileWidth();
+        auto const height = dst.getTileHeight();
+        auto const dstRect = dst.getRect();
+        if ( !order || !width || !height || !dstRect )
+          { return APIResults::Failed; }
+
+        std::vector< Int > indexs{};
+        switch ( *order )
+          {
+            case Offscreen::ChannelOrders::GrayAlpha:
+            case Offscreen::ChannelOrders::BinarizationGrayAlpha:
+              indexs.push_back( 0 );
+              break;
+
+            case Offscreen::ChannelOrders::RGBAlpha:
+              if ( auto const x = dst.getRGBChannelIndex() )
+                { indexs = { std::get< 0 >( *x ), std::get< 1 >( *x ), std::get< 2 >( *x ) }; }
+              else
+                { return x.state(); }
+              break;
+
+            case Offscreen::ChannelOrders::CMYKAlpha:
+              if ( auto const x = dst.getCMYKChannelIndex() )
+                { indexs = { std::get< 0 >( *x ), std::get< 1 >( *x ), std::get< 2 >( *x ), std::get< 3 >( *x ) }; }
+              else
+                { return x.state(); }
+              break;
+
+            case Offscreen::ChannelOrders::Alpha:
+            case Offscreen::ChannelOrders::BinarizationAlpha:
+            case Offscreen::ChannelOrders::SelectArea:
+            case Offscreen::ChannelOrders::Plane:
+              break;
+          }
+
+        Offscreen selectArea{};
+        if ( *hasSelectArea )
+          {
+            if ( auto const x = fr.getSelectAreaOffscreen() )
+              { selectArea = makeOffscreenWithObject( server, *x, false ); }
+            else
+              { return x.state(); }
+          }
+
+        sourceOffscreen = std::move( src );
+        destinationOffscreen = std::move( dst );
+        selectAreaOffscreen = std::move( selectArea );
+        channelOrder = *order;
+        channelIndexs = std::move( indexs );
+        selectAreaRect = *rect;
+        destinationRect = *dstRect;
+        tileWidth = *width;
+        tileHeight = *height;
+        hasSelectAreaOffscreen = *hasSelectArea;
+
+        // Not every filter needs these, so a host that cannot answer leaves them failed instead of failing the run
+        layerOrigin = fr.getLayerOrigin();
+        isAlphaLocked = fr.isAlphaLocked();
+        isLayerMaskSelected = fr.isLayerMaskSelected();
+        return APIResults::Success;
+      }
+
+    Offscreen sourceOffscreen;
+    Offscreen destinationOffscreen;
+    Offscreen selectAreaOffscreen;
+    Offscreen::ChannelOrders channelOrder{};
+    std::vector< Int > channelIndexs;
+    Rect selectAreaRect{};
+    Rect destinationRect{};
+    Int tileWidth{};
+    Int tileHeight{};
+    bool hasSelectAreaOffscreen{};
+    APIResult< Point > layerOrigin{};
+    APIResult< bool > isAlphaLocked{};
+    APIResult< bool > isLayerMaskSelected{};
+  };
+
+inline auto makeFilterRunContext( std::weak_ptr< Server const > const &server ) -> FilterRunContext
+  {
+    FilterRunContext result{};
+    result.make( server );
+    return result;
+  }
+
+
+enum class BlockPlanes : UInt8
+  {
+    None = 0,
+    Image = 1 << 0,
+    Alpha = 1 << 1,
+    SelectArea = 1 << 2,
+    All = Image | Alpha | SelectArea,
+  };
+
+constexpr auto operator |( BlockPlanes a, BlockPlanes b ) noexcept -> BlockPlanes
+  { return static_cast< BlockPlanes >( static_cast< UInt8 >( a ) | static_cast< UInt8 >( b ) ); }
+
+constexpr auto operator &( BlockPlanes a, BlockPlanes b ) noexcept -> BlockPlanes
+  { return static_cast< BlockPlanes >( static_cast< UInt8 >( a ) & static_cast< UInt8 >( b ) ); }
+
+constexpr auto hasPlanes( BlockPlanes x, BlockPlanes planes ) noexcept -> bool
+  { return ( x & planes ) == planes; }
+
+
+struct BlockBundle
+  {
+    Int index;
+    Rect rect;
+    bool restarted;
+    Offscreen::MutableBlock image;
+    Offscreen::MutableBlock alpha;
+    Offscreen::Block selectArea;
+  };
+
+
+struct UpdateOptions
+  {
+    std::size_t maxPendingPixels = 1024 * 1024;
+    std::size_t maxPendingRects = 16; // at most UpdateAggregator::kMaxPendingRects
+    std::size_t maxWastePixels = 0;
+    double maxDelaySeconds = 0.05;
+    double progressIntervalSeconds = 0.05;
+  };
+
+
+// Coalesces destination updates and throttles progress so small blocks do not flood the host.
+// Pending rects live in a fixed array so adding one never allocates and BlockRange can stay noexcept
+class UpdateAggregator
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    constexpr static std::size_t kMaxPendingRects = 64;
+
+    ~UpdateAggregator() = default;
+    UpdateAggregator() = default;
+    UpdateAggregator( UpdateAggregator const & ) = delete;
+    UpdateAggregator( UpdateAggregator && ) = default;
+    auto operator =( UpdateAggregator const & ) -> UpdateAggregator & = delete;
+    auto operator =( UpdateAggregator && ) -> UpdateAggregator & = default;
+
+    explicit UpdateAggregator( UpdateOptions const &options )
+      : options_{ options }
+      {}
+
+    auto options() const noexcept -> UpdateOptions const &
+      { return options_; }
+
+    void setOptions( UpdateOptions const &options ) noexcept
+      { options_ = options; }
+
+    void reset() noexcept
+      {
+        pendingCount_ = 0;
+        pendingPixels_ = 0;
+        progress_ = -1;
+        reportedProgress_ = -1;
+        updates_ = 0;
+        updateSeconds_ = 0;
+      }
+
+    void add( FilterRunner const &runner, Rect const &rect ) noexcept
+      {
+        if ( isEmpty( rect ) )
+          { return; }
+
+        auto const now = Clock::now();
+        if ( !pendingCount_ )
+          { pendingSince_ = now; }
+
+        // Absorb every pending rect whose union with this one covers at most maxWastePixels outside both
+        auto x = rect;
+        for ( std::size_t i = 0; i < pendingCount_; )
+          {
+            auto const &y = pending_[ i ];
+            auto const u = unite( y, x );
+            if ( area( u ) + area( intersect( y, x ) ) <= area( y ) + area( x ) + options_.maxWastePixels )
+              {
+                pendingPixels_ -= area( y );
+                x = u;
+                std::copy( pending_ + i + 1, pending_ + pendingCount_, pending_ + i );
+                --pendingCount_;
+                i = 0;
+              }
+            else
+              { ++i; }
+          }
+        pending_[ pendingCount_++ ] = x;
+        pendingPixels_ += area( x );
+
+        auto const maxRects = options_.maxPendingRects < kMaxPendingRects ? options_.maxPendingRects : kMaxPendingRects;
+        if ( pendingPixels_ >= options_.maxPendingPixels || pendingCount_ >= maxRects || seconds( pendingSince_, now ) >= options_.maxDelaySeconds )
+          { flushUpdates( runner ); }
+      }
+
+    void progress( FilterRunner const &runner, Int done ) noexcept
+      {
+        progress_ = done;
+        if ( reportedProgress_ < 0 )
+          { flushProgress( runner, Clock::now() ); }
+        poll( runner );
+      }
+
+    // Sends what has waited past its time budget, even when no further blocks are added
+    void poll( FilterRunner const &runner ) noexcept
+      {
+        auto const now = Clock::now();
+        if ( pendingCount_ && seconds( pendingSince_, now ) >= options_.maxDelaySeconds )
+          { flushUpdates( runner ); }
+        if ( seconds( progressAt_, now ) >= options_.progressIntervalSeconds )
+          { flushProgress( runner, now ); }
+      }
+
+    // Sends every pending update and the latest progress; must run before process( End )
+    void flush( FilterRunner const &runner ) noexcept
+      {
+        flushUpdates( runner );
+        flushProgress( runner, Clock::now() );
+      }
+
+    auto updates() const noexcept -> Int
+      { return updates_; }
+
+    auto updateSeconds() const noexcept -> double
+      { return updateSeconds_; }
+
+  private:
+    void flushUpdates( FilterRunner const &runner ) noexcept
+      {
+        for ( std::size_t i = 0; i < pendingCount_; ++i )
+          {
+            auto const start = Clock::now();
+            runner.updateDestinationOffscreenRect( pending_[ i ] );
+            updateSeconds_ += seconds( start, Clock::now() );
+            ++updates_;
+          }
+        pendingCount_ = 0;
+        pendingPixels_ = 0;
+      }
+
+    void flushProgress( FilterRunner const &runner, Clock::time_point now ) noexcept
+      {
+        if ( progress_ < 0 || progress_ == reportedProgress_ )
+          { return; }
+        runner.setProgressDone( progress_ );
+        reportedProgress_ = progress_;
+        progressAt_ = now;
+      }
+
+    static auto seconds( Clock::time_point a, Clock::time_point b ) noexcept -> double
+      { return std::chrono::duration< double >( b - a ).count(); }
+
+    UpdateOptions options_{};
+    Rect pending_[ kMaxPendingRects ]{};
+    std::size_t pendingCount_{};
+    std::size_t pendingPixels_{};
+    Clock::time_point pendingSince_{};
+    Int progress_{ -1 };
+    Int reportedProgress_{ -1 };
+    Clock::time_point progressAt_{};
+    Int updates_{};
+    double updateSeconds_{};
+  };
+
+
+class BlockRange
+  {
+  public:
+    constexpr static std::size_t kMaxUpdateRects = 4;
+
+    class Iterator
+      {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = BlockBundle;
+        using difference_type = std::ptrdiff_t;
+        using pointer = BlockBundle const *;
+        using reference = BlockBundle const &;
+
+        constexpr Iterator() noexcept : range_{} {}
+        constexpr explicit Iterator( BlockRange *range ) noexcept : range_{ range } {}
+
+        auto operator *() const noexcept -> BlockBundle const &
+          { return range_->bundle_; }
+
+        auto operator->() const noexcept -> BlockBundle const *
+          { return &range_->bundle_; }
+
+        auto operator ++() noexcept -> Iterator &
+          {
+            range_->next();
+            return *this;
+          }
+
+        auto operator ==( Iterator const &x ) const noexcept -> bool
+          { return isEnd() == x.isEnd(); }
+
+        auto operator !=( Iterator const &x ) const noexcept -> bool
+          { return !( *this == x ); }
+
+      private:
+        auto isEnd() const noexcept -> bool
+          { return !range_ || range_->done_; }
+
+        BlockRange *range_;
+      };
+
+    ~BlockRange() = default;
+    BlockRange( BlockRange const & ) = delete;
+    BlockRange( BlockRange && ) = default;
+    auto operator =( BlockRange const & ) -> BlockRange & = delete;
+    auto operator =( BlockRange && ) -> BlockRange & = default;
+
+    BlockRange( FilterRunner const &runner, Offscreen const &offscreen, Offscreen const &selectAreaOffscreen, BlockGrid const &grid, BlockPlanes planes, std::vector< bool > skips = {} ) noexcept
+      : runner_{ runner }
+      , offscreen_{ offscreen }
+      , selectAreaOffscreen_{ selectAreaOffscreen }
+      , grid_{ grid }
+      , planes_{ planes }
+      , skips_{ std::move( skips ) }
+      , index_{}
+      , restarts_{}
+      , restarted_{}
+      , failed_{}
+      , done_{ true }
+      , bundle_{}
+      , updates_{}
+      , updateCount_{}
+      , aggregator_{}
+      {}
+
+    auto begin() noexcept -> Iterator
+      {
+        runner_.setProgressTotal( grid_.count() );
+        index_ = 0;
+        restarts_ = 0;
+        restarted_ = true;
+        failed_ = false;
+        aggregator_.reset();
+        done_ = false;
+        advance( process() );
+        return Iterator{ this };
+      }
+
+    auto end() noexcept -> Iterator
+      { return Iterator{}; }
+
+    auto grid() const noexcept -> BlockGrid const &
+      { return grid_; }
+
+    auto planes() const noexcept -> BlockPlanes
+      { return planes_; }
+
+    // Number of times the host restarted the run
+    auto restarts() const noexcept -> Int
+      { return restarts_; }
+
+    // True when the host failed a process call, which ends the iteration early
+    auto failed() const noexcept -> bool
+      { return failed_; }
+
+    // Narrows the rect reported for the current block; an empty rect reports nothing
+    void setUpdateRect( Rect const &rect ) noexcept
+      {
+        updates_[ 0 ] = rect;
+        updateCount_ = 1;
+      }
+
+    // Reports the current block as up to kMaxUpdateRects rects; more are reported as their union
+    template < class Rects >
+    void setUpdateRects( Rects const &rects ) noexcept
+      {
+        updateCount_ = 0;
+        for ( auto &&x : rects )
+          {
+            if ( updateCount_ < kMaxUpdateRects )
+              { updates_[ updateCount_++ ] = x; }
+            else
+              { updates_[ kMaxUpdateRects - 1 ] = unite( updates_[ kMaxUpdateRects - 1 ], x ); }
+          }
+      }
+
+    void setUpdateOptions( UpdateOptions const &options ) noexcept
+      { aggregator_.setOptions( options ); }
+
+    auto updates() const noexcept -> Int
+      { return aggregator_.updates(); }
+
+    auto updateSeconds() const noexcept -> double
+      { return aggregator_.updateSeconds(); }
+
+  private:
+    void next() noexcept
+      {
+        for ( std::size_t i = 0; i < updateCount_; ++i )
+          { aggregator_.add( runner_, updates_[ i ] ); }
+        ++index_;
+        aggregator_.progress( runner_, index_ );
+        advance( process() );
+      }
+
+    auto process() noexcept -> FilterRunner::ProcessResults
+      {
+        using S = FilterRunner::ProcessStates;
+        auto const state = index_ < grid_.count() ? !index_ ? S::Start : S::Continue : S::End;
+        if ( state == S::End )
+          { aggregator_.flush( runner_ ); }
+        else
+          { aggregator_.poll( runner_ ); }
+        if ( auto const result = runner_.process( state ) )
+          { return *result; }
+        failed_ = true;
+        return FilterRunner::ProcessResults::Exit;
+      }
+
+    void advance( FilterRunner::ProcessResults result ) noexcept
+      {
+        using R = FilterRunner::ProcessResults;
+        for ( ; result != R::Exit; result = process() )
+          {
+            if ( result == R::Restart )
+              {
+                index_ = 0;
+                ++restarts_;
+                restarted_ = true;
+                continue;
+              }
+            if ( index_ >= grid_.count() )
+              { continue; }
+            if ( isSkipped( index_ ) )
+              {
+                // Skipped blocks are left untouched, so there is nothing to update
+                ++index_;
+                aggregator_.progress( runner_, index_ );
+                continue;
+              }
+            if ( fetch() )
+              {
+                restarted_ = false;
+                return;
+              }
+            aggregator_.add( runner_, bundle_.rect );
+            ++index_;
+            aggregator_.progress( runner_, index_ );
+          }
+        aggregator_.flush( runner_ );
+        done_ = true;
+      }
+
+    auto isSkipped( Int index ) const noexcept -> bool
+      { return static_cast< std::size_t >( index ) < skips_.size() && skips_[ static_cast< std::size_t >( index ) ]; }
+
+    auto fetch() noexcept -> bool
+      {
+        static Byte const one = toByte( 0xFF );
+
+        bundle_ = BlockBundle{};
+        bundle_.index = index_;
+        bundle_.rect = grid_.rect( index_ );
+        bundle_.restarted = restarted_;
+        setUpdateRect( bundle_.rect );
+        Point const pos{ bundle_.rect.left, bundle_.rect.top };
+
+        if ( hasPlanes( planes_, BlockPlanes::Alpha ) )
+          {
+            if ( auto const x = offscreen_.getMutableBlockAlpha( pos ) )
+              { bundle_.alpha = *x; }
+            else
+              { return false; }
+          }
+
+        if ( hasPlanes( planes_, BlockPlanes::Image ) )
+          {
+            if ( auto const x = offscreen_.getMutableBlockImage( pos ) )
+              { bundle_.image = *x; }
+            else
+              { return false; }
+          }
+
+        if ( hasPlanes( planes_, BlockPlanes::SelectArea ) )
+          {
+            if ( !selectAreaOffscreen_ )
+              { bundle_.selectArea = Offscreen::Block{ &one, 0, 0, bundle_.rect }; }
+            else if ( auto const x = selectAreaOffscreen_.getBlockSelectArea( pos ) )
+              { bundle_.selectArea = *x; }
+            else
+              { return false; }
+          }
+
+        return true;
+      }
+
+    FilterRunner runner_;
+    Offscreen offscreen_;
+    Offscreen selectAreaOffscreen_;
+    BlockGrid grid_;
+    BlockPlanes planes_;
+    std::vector< bool > skips_;
+    Int index_;
+    Int restarts_;
+    bool restarted_;
+    bool failed_;
+    bool done_;
+    BlockBundle bundle_;
+    Rect updates_[ kMaxUpdateRects ];
+    std::size_t updateCount_;
+    UpdateAggregator aggregator_;
+  };
+
+// Blocks whose entry in skips is true are never fetched nor reported as updated
+inline auto makeBlockRange( FilterRunner const &runner, FilterRunContext const &context, BlockGrid const &grid, BlockPlanes planes, std::vector< bool > skips = {} ) noexcept -> BlockRange
+  {
+    if ( context.channelIndexs.empty() )
+      { planes = planes & ( BlockPlanes::Alpha | BlockPlanes::SelectArea ); }
+    return BlockRange{ runner, context.destinationOffscreen, context.selectAreaOffscreen, grid, planes, std::move( skips ) };
+  }
+
 }} // namespace Triglav::PlugIn
 
 #endif // cspsdkxx_triglavpluginsdk_trigravpluginsdk_hh_